@@ -0,0 +1,346 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include "CpuProfiler.hpp"
+#include "Engine.hpp"
+#include "Statistics.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchmarkConfig {
+    EngineConfig engine{ .framesInFlight = 2, .headless = true };
+
+    size_t warmupFrames = 60;
+    size_t frames = 600;
+
+    // Simulated time per frame in milliseconds, independent of how long frames actually take
+    double frameStep = 1000.0 / 60.0;
+
+    // Runs half the warmup with each render path and measures with the one whose median GPU
+    // frame time was lower
+    bool autoRenderPath = false;
+
+    std::string outputPath;
+    std::string gpuProfilePath;
+    std::string cpuTracePath;
+    std::string shadowReportPath;
+};
+
+// The camera orbits the scene once every 20 seconds of simulated time while bobbing vertically
+static void applyTimeline(Engine& engine, double time)
+{
+    const double orbitPeriod = 20000.0;
+    const float angle = static_cast<float>(2.0 * glm::pi<double>() * time / orbitPeriod);
+
+    glm::vec3 position(9.0f * sin(angle), 2.0f * sin(2.0f * angle), 9.0f * cos(angle));
+    engine.getCamera().lookAt(position, glm::vec3(0.0f));
+
+    engine.setLightTime(static_cast<float>(time));
+}
+
+static constexpr const char* GBUFFER_LAYOUT_NAMES[] = { "full", "compact", "visibility" };
+
+static GBufferLayout parseGBufferLayout(const char* name)
+{
+    for (size_t i = 0; i < std::size(GBUFFER_LAYOUT_NAMES); i++)
+    {
+        if (strcmp(name, GBUFFER_LAYOUT_NAMES[i]) == 0) return static_cast<GBufferLayout>(i);
+    }
+    throw std::runtime_error(std::format("Unknown G-buffer layout {}", name));
+}
+
+static constexpr const char* RENDER_PATH_NAMES[] = { "deferred", "forward-plus" };
+
+static RenderPath parseRenderPath(const char* name)
+{
+    for (size_t i = 0; i < std::size(RENDER_PATH_NAMES); i++)
+    {
+        if (strcmp(name, RENDER_PATH_NAMES[i]) == 0) return static_cast<RenderPath>(i);
+    }
+    throw std::runtime_error(std::format("Unknown render path {}", name));
+}
+
+static BenchmarkConfig parseArguments(int argc, char** argv)
+{
+    BenchmarkConfig config{};
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            config.frames = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            config.warmupFrames = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+            config.engine.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--width") == 0 && hasValue)
+            config.engine.extent.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--height") == 0 && hasValue)
+            config.engine.extent.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--windowed") == 0)
+            config.engine.headless = false;
+        else if (strcmp(argv[i], "--per-face-shadows") == 0)
+            config.engine.perFaceShadowDraws = true;
+        else if (strcmp(argv[i], "--geometry-shadows") == 0)
+            config.engine.geometryShaderShadows = true;
+        else if (strcmp(argv[i], "--shadow-d32") == 0)
+            config.engine.shadowFormat = VK_FORMAT_D32_SFLOAT;
+        else if (strcmp(argv[i], "--no-shadow-pcf") == 0)
+            config.engine.shadowPcf = false;
+        else if (strcmp(argv[i], "--shadow-mask") == 0)
+            config.engine.shadowMask = true;
+        else if (strcmp(argv[i], "--compute-lighting") == 0)
+            config.engine.computeLighting = true;
+        else if (strcmp(argv[i], "--gbuffer") == 0 && hasValue)
+            config.engine.gBufferLayout = parseGBufferLayout(argv[++i]);
+        else if (strcmp(argv[i], "--render-path") == 0 && hasValue)
+        {
+            config.autoRenderPath = strcmp(argv[++i], "auto") == 0;
+            config.engine.renderPath =
+                config.autoRenderPath ? RenderPath::Deferred : parseRenderPath(argv[i]);
+        }
+        else if (strcmp(argv[i], "--fill-lights") == 0 && hasValue)
+            config.engine.fillLights = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--light-cutoff") == 0 && hasValue)
+            config.engine.lightCutoff = std::stof(argv[++i]);
+        else if (strcmp(argv[i], "--shadow-face-budget") == 0 && hasValue)
+            config.engine.shadowFaceBudget = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--shadow-budget-ms") == 0 && hasValue)
+            config.engine.shadowBudgetMs = std::stod(argv[++i]);
+        else if (strcmp(argv[i], "--shadow-report") == 0 && hasValue)
+            config.shadowReportPath = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+            config.outputPath = argv[++i];
+        else if (strcmp(argv[i], "--gpu-profile") == 0 && hasValue)
+            config.gpuProfilePath = argv[++i];
+        else if (strcmp(argv[i], "--cpu-trace") == 0 && hasValue)
+            config.cpuTracePath = argv[++i];
+        else
+            throw std::runtime_error(std::format("Unknown argument {}", argv[i]));
+    }
+
+    return config;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkConfig config = parseArguments(argc, argv);
+
+    PROFILE_THREAD_NAME("main");
+
+    std::unique_ptr<Engine> engine = std::make_unique<Engine>(config.engine);
+
+    const GpuProfiler& profiler = engine->getGpuProfiler();
+
+    std::vector<double> cpuFrameTimes;
+    std::vector<double> gpuFrameTimes;
+    std::vector<double> shadowRefreshed;
+    std::vector<double> shadowDeferred;
+    std::vector<double> shadowCasters;
+    std::vector<double> visibleLights;
+    std::string shadowReport;
+    std::vector<std::string> passNames;
+    std::map<std::string, std::vector<double>> passTimes;
+
+    // GPU frame times of each render path during an automatic warmup, indexed by RenderPath
+    std::array<std::vector<double>, 2> renderPathTimes;
+    const size_t renderPathSwitch = config.warmupFrames / 2;
+
+    // GPU timings are resolved framesInFlight frames late and are matched by frame number
+    uint64_t lastGpuFrame = UINT64_MAX;
+    const size_t totalFrames = config.warmupFrames + config.frames;
+    for (size_t frame = 0; frame < totalFrames; frame++)
+    {
+        if (config.autoRenderPath && frame == renderPathSwitch)
+            engine->setRenderPath(RenderPath::ForwardPlus);
+
+        // The last warmup frames may not have resolved yet, the medians only need most of them
+        if (config.autoRenderPath && frame == config.warmupFrames)
+        {
+            Statistics deferred = computeStatistics(renderPathTimes[0]);
+            Statistics forward = computeStatistics(renderPathTimes[1]);
+            bool forwardCheaper = !renderPathTimes[1].empty() &&
+                                  (renderPathTimes[0].empty() || forward.p50 < deferred.p50);
+            engine->setRenderPath(forwardCheaper ? RenderPath::ForwardPlus : RenderPath::Deferred);
+        }
+
+        double time = frame * config.frameStep;
+        applyTimeline(*engine, time);
+
+        auto start = std::chrono::steady_clock::now();
+        engine->step(0.0);
+        auto end = std::chrono::steady_clock::now();
+
+        if (frame >= config.warmupFrames)
+        {
+            cpuFrameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+            const ShadowUpdateReport& report = engine->getShadowUpdateReport();
+            shadowRefreshed.push_back(static_cast<double>(report.refreshedFaces.size()));
+            shadowDeferred.push_back(static_cast<double>(report.deferredFaces));
+            shadowCasters.push_back(static_cast<double>(engine->getShadowCasterCount()));
+            visibleLights.push_back(static_cast<double>(engine->getLightCount()));
+
+            if (!config.shadowReportPath.empty())
+            {
+                std::string faces;
+                for (uint32_t face : report.refreshedFaces)
+                    faces += std::format("{}{}", faces.empty() ? "" : ", ", face);
+
+                if (!shadowReport.empty()) shadowReport += ",\n";
+                shadowReport += std::format(
+                    "  {{ \"frame\": {}, \"refreshed\": [{}], \"deferred\": {} }}",
+                    report.frame, faces, report.deferredFaces);
+            }
+        }
+
+        uint64_t gpuFrame = profiler.getLastResolvedFrame();
+        if (profiler.getLastFrameEvents().empty() || gpuFrame == lastGpuFrame) continue;
+        lastGpuFrame = gpuFrame;
+
+        if (gpuFrame < config.warmupFrames)
+        {
+            if (!config.autoRenderPath) continue;
+
+            for (const GpuScopeEvent& event : profiler.getLastFrameEvents())
+            {
+                if (profiler.getStats()[event.scope].name != "frame") continue;
+
+                size_t path = gpuFrame < renderPathSwitch ? 0 : 1;
+                renderPathTimes[path].push_back((event.endNs - event.beginNs) * 1e-6);
+            }
+            continue;
+        }
+
+        for (const GpuScopeEvent& event : profiler.getLastFrameEvents())
+        {
+            const std::string& name = profiler.getStats()[event.scope].name;
+            double ms = (event.endNs - event.beginNs) * 1e-6;
+
+            if (name == "frame")
+            {
+                gpuFrameTimes.push_back(ms);
+                continue;
+            }
+
+            if (!passTimes.contains(name)) passNames.push_back(name);
+            passTimes[name].push_back(ms);
+        }
+    }
+
+    engine->waitIdle();
+
+    const ShadowAtlas& atlas = engine->getShadowAtlas();
+
+    std::string passJson;
+    for (const std::string& name : passNames)
+    {
+        if (!passJson.empty()) passJson += ",\n";
+        passJson += std::format("    \"{}\": {}", name, toJson(computeStatistics(passTimes[name])));
+    }
+
+    const char* gBufferLayout =
+        GBUFFER_LAYOUT_NAMES[static_cast<int>(config.engine.gBufferLayout)];
+    const char* renderPath = RENDER_PATH_NAMES[static_cast<int>(engine->getRenderPath())];
+
+    // Only an automatic pick has warmup timings to compare
+    std::string renderPathJson;
+    if (config.autoRenderPath)
+    {
+        renderPathJson =
+            std::format("  \"renderPathWarmupGpuMs\": {{ \"{}\": {}, \"{}\": {} }},\n",
+                        RENDER_PATH_NAMES[0], toJson(computeStatistics(renderPathTimes[0])),
+                        RENDER_PATH_NAMES[1], toJson(computeStatistics(renderPathTimes[1])));
+    }
+
+    std::string json = std::format("{{\n"
+                                   "  \"frames\": {},\n"
+                                   "  \"warmupFrames\": {},\n"
+                                   "  \"width\": {},\n"
+                                   "  \"height\": {},\n"
+                                   "  \"framesInFlight\": {},\n"
+                                   "  \"perFaceShadowDraws\": {},\n"
+                                   "  \"geometryShaderShadows\": {},\n"
+                                   "  \"shadowPcf\": {},\n"
+                                   "  \"shadowMask\": {},\n"
+                                   "  \"computeLighting\": {},\n"
+                                   "  \"gBufferLayout\": \"{}\",\n"
+                                   "  \"renderPath\": \"{}\",\n"
+                                   "  \"autoRenderPath\": {},\n"
+                                   "{}"
+                                   "  \"fillLights\": {},\n"
+                                   "  \"lightCutoff\": {},\n"
+                                   "  \"sceneLights\": {},\n"
+                                   "  \"visibleLights\": {},\n"
+                                   "  \"shadowAtlas\": {{ \"width\": {}, \"height\": {}, "
+                                   "\"bytes\": {} }},\n"
+                                   "  \"shadowFacesRefreshed\": {},\n"
+                                   "  \"shadowFacesDeferred\": {},\n"
+                                   "  \"shadowCasters\": {},\n"
+                                   "  \"cpuFrameMs\": {},\n"
+                                   "  \"gpuFrameMs\": {},\n"
+                                   "  \"passesGpuMs\": {{\n{}\n  }}\n"
+                                   "}}\n",
+                                   config.frames, config.warmupFrames,
+                                   config.engine.extent.width, config.engine.extent.height,
+                                   config.engine.framesInFlight,
+                                   config.engine.perFaceShadowDraws,
+                                   config.engine.geometryShaderShadows, config.engine.shadowPcf,
+                                   config.engine.shadowMask, config.engine.computeLighting,
+                                   gBufferLayout, renderPath, config.autoRenderPath,
+                                   renderPathJson, config.engine.fillLights,
+                                   config.engine.lightCutoff,
+                                   engine->getSceneLightCount(),
+                                   toJson(computeStatistics(visibleLights)),
+                                   atlas.getExtent().width, atlas.getExtent().height,
+                                   atlas.getMemoryUsage(),
+                                   toJson(computeStatistics(shadowRefreshed)),
+                                   toJson(computeStatistics(shadowDeferred)),
+                                   toJson(computeStatistics(shadowCasters)),
+                                   toJson(computeStatistics(cpuFrameTimes)),
+                                   toJson(computeStatistics(gpuFrameTimes)), passJson);
+
+    if (config.outputPath.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream file(config.outputPath);
+        if (!file) throw std::runtime_error(std::format("Failed to open {}", config.outputPath));
+        file << json;
+    }
+
+    if (!config.gpuProfilePath.empty())
+    {
+        std::ofstream file(config.gpuProfilePath);
+        if (!file)
+            throw std::runtime_error(std::format("Failed to open {}", config.gpuProfilePath));
+        profiler.exportJson(file);
+    }
+
+    if (!config.shadowReportPath.empty())
+    {
+        std::ofstream file(config.shadowReportPath);
+        if (!file)
+            throw std::runtime_error(std::format("Failed to open {}", config.shadowReportPath));
+        file << "[\n" << shadowReport << "\n]\n";
+    }
+
+    // Empty unless built with ENABLE_PROFILING
+    if (!config.cpuTracePath.empty()) CpuProfiler::writeChromeTrace(config.cpuTracePath);
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include "JobSystem.hpp"
+#include "SceneData.hpp"
+#include "Statistics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs the engine's per-frame CPU update over a large synthetic scene once per thread count,
+// without a device, so the job system's scaling can be measured on its own
+struct ScalingConfig {
+    size_t objects = 10000;
+    size_t lights = 256;
+
+    size_t warmupFrames = 30;
+    size_t frames = 300;
+
+    // 0 goes up to the number of hardware threads
+    size_t maxThreads = 0;
+
+    size_t objectsPerJob = 256;
+    size_t lightsPerJob = 16;
+
+    std::string outputPath;
+};
+
+static ScalingConfig parseArguments(int argc, char** argv)
+{
+    ScalingConfig config{};
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--objects") == 0 && hasValue)
+            config.objects = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--lights") == 0 && hasValue)
+            config.lights = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            config.frames = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            config.warmupFrames = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--max-threads") == 0 && hasValue)
+            config.maxThreads = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+            config.outputPath = argv[++i];
+        else
+            throw std::runtime_error(std::format("Unknown argument {}", argv[i]));
+    }
+
+    if (config.maxThreads == 0)
+        config.maxThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    return config;
+}
+
+struct Scene {
+    std::vector<ObjectTransform> transforms;
+    std::vector<ObjectData> objects;
+    std::vector<LightData> lights;
+    std::vector<ShadowFaceData> shadowFaces;
+};
+
+static Scene createScene(const ScalingConfig& config)
+{
+    Scene scene;
+
+    // Objects on a square grid, lights on a coarser one above it
+    size_t side = static_cast<size_t>(std::ceil(std::sqrt(config.objects)));
+    for (size_t i = 0; i < config.objects; i++)
+    {
+        glm::vec3 position(2.0f * (i % side), 0.0f, 2.0f * (i / side));
+        scene.transforms.push_back(
+            { .position = position, .rotationAxis = glm::vec3(1.0f, -0.3f, 0.5f) });
+        scene.objects.push_back({ .materialIndex = 0, .colour = glm::vec4(1.0f) });
+    }
+
+    size_t lightSide = static_cast<size_t>(std::ceil(std::sqrt(config.lights)));
+    float spacing = 2.0f * side / std::max<size_t>(lightSide, 1);
+    for (size_t i = 0; i < config.lights; i++)
+    {
+        LightData light{};
+        light.position = glm::vec3(spacing * (i % lightSide), 3.0f, spacing * (i / lightSide));
+        light.shadowIndex = static_cast<uint32_t>(i * 6);
+        scene.lights.push_back(light);
+    }
+    scene.shadowFaces.resize(scene.lights.size() * 6);
+
+    return scene;
+}
+
+// Same shape as Engine::update(), objects go to the workers while this thread starts on lights
+static void updateScene(JobSystem& jobs, Scene& scene, const ScalingConfig& config, float time)
+{
+    JobHandle objects =
+        jobs.parallelFor(scene.objects.size(), config.objectsPerJob,
+                         [&scene, time](size_t begin, size_t end, size_t) {
+                             for (size_t i = begin; i < end; i++)
+                             {
+                                 scene.transforms[i].angle = time * 0.01f + i;
+                                 updateObjectMatrices(scene.objects[i], scene.transforms[i]);
+                             }
+                         });
+
+    std::span<ShadowFaceData> shadowFaces = scene.shadowFaces;
+    JobHandle lights = jobs.parallelFor(
+        scene.lights.size(), config.lightsPerJob,
+        [&scene, shadowFaces](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++)
+                updateShadowFaceMatrices(scene.lights[i], shadowFaces.subspan(i * 6, 6));
+        });
+
+    jobs.wait(objects);
+    jobs.wait(lights);
+}
+
+int main(int argc, char** argv)
+{
+    ScalingConfig config = parseArguments(argc, argv);
+
+    Scene scene = createScene(config);
+
+    double singleThreadMean = 0.0;
+    std::string runJson;
+    for (size_t threads = 1; threads <= config.maxThreads; threads++)
+    {
+        JobSystem jobs;
+        jobs.create(threads - 1);
+
+        std::vector<double> frameTimes;
+        const size_t totalFrames = config.warmupFrames + config.frames;
+        for (size_t frame = 0; frame < totalFrames; frame++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            updateScene(jobs, scene, config, frame * (1000.0f / 60.0f));
+            auto end = std::chrono::steady_clock::now();
+
+            if (frame < config.warmupFrames) continue;
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        jobs.destroy();
+
+        Statistics stats = computeStatistics(frameTimes);
+        if (threads == 1) singleThreadMean = stats.mean;
+
+        if (!runJson.empty()) runJson += ",\n";
+        runJson += std::format("    {{ \"threads\": {}, \"cpuFrameMs\": {}, \"speedup\": {:.3f} }}",
+                               threads, toJson(stats), singleThreadMean / stats.mean);
+    }
+
+    std::string json = std::format("{{\n"
+                                   "  \"objects\": {},\n"
+                                   "  \"lights\": {},\n"
+                                   "  \"frames\": {},\n"
+                                   "  \"warmupFrames\": {},\n"
+                                   "  \"runs\": [\n{}\n  ]\n"
+                                   "}}\n",
+                                   config.objects, config.lights, config.frames,
+                                   config.warmupFrames, runJson);
+
+    if (config.outputPath.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream file(config.outputPath);
+        if (!file) throw std::runtime_error(std::format("Failed to open {}", config.outputPath));
+        file << json;
+    }
+
+    return 0;
+}
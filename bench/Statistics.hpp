@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <numeric>
+#include <string>
+#include <vector>
+
+struct Statistics {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+};
+
+inline Statistics computeStatistics(std::vector<double> samples)
+{
+    if (samples.empty()) return {};
+
+    std::sort(samples.begin(), samples.end());
+
+    // Nearest-rank percentile
+    auto percentile = [&samples](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    Statistics stats;
+    stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    stats.p50 = percentile(0.50);
+    stats.p99 = percentile(0.99);
+    return stats;
+}
+
+inline std::string toJson(const Statistics& stats)
+{
+    return std::format("{{ \"mean\": {:.4f}, \"p50\": {:.4f}, \"p99\": {:.4f} }}", stats.mean,
+                       stats.p50, stats.p99);
+}
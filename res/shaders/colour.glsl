@@ -0,0 +1,9 @@
+vec3 gammaCorrect(vec3 colour)
+{
+    return pow(colour, vec3(1./2.2));
+}
+
+vec4 invGamma(vec4 colour)
+{
+    return vec4(pow(colour.rgb, vec3(2.2)), colour.a);
+}
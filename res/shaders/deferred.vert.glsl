@@ -12,6 +12,9 @@ layout (location = 2) out vec3 v_Normal;
 layout (location = 3) out vec4 v_FragPos;
 layout (location = 4) out flat int v_MaterialIndex;
 
+// The forward path draws this after depth.vert.glsl and tests for equal depth
+invariant gl_Position;
+
 void main()
 {
     Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
@@ -0,0 +1,32 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "material.glsl"
+#include "colour.glsl"
+#include "octahedral.glsl"
+
+layout (location = 0) in vec2 v_UV;
+layout (location = 1) in vec4 v_Colour;
+layout (location = 2) in vec3 v_Normal;
+layout (location = 3) in vec4 v_FragPos;
+layout (location = 4) in flat int v_MaterialIndex;
+
+layout (location = 0) out vec2 f_Normal;
+layout (location = 1) out vec4 f_Albedo;
+
+// The compact layout of gbuffer.glsl. Position comes from the depth buffer, and the albedo is
+// sampled here so the lighting pass reads one texel instead of two textures
+void main()
+{
+    vec3 albedo = vec3(1.0);
+    if (v_MaterialIndex == 0)
+    {
+        vec4 box = invGamma(texture(u_BoxSampler, v_UV));
+        vec4 face = invGamma(texture(u_FaceSampler, v_UV));
+        albedo = mix(box, face, 0.5).rgb;
+    }
+
+    // The sRGB target encodes the linear albedo on write and decodes it on read
+    f_Normal = octahedralEncode(normalize(v_Normal));
+    f_Albedo = vec4(albedo, float(v_MaterialIndex) / 255.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex.glsl"
+#include "object.glsl"
+
+// Matches deferred.vert.glsl bit for bit, so the forward pass can test for equal depth
+invariant gl_Position;
+
+void main()
+{
+    Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+    mat4 model = u_Models.objects[gl_InstanceIndex].model;
+
+    gl_Position = PushConstants.proj * PushConstants.view * model * vec4(v.position, 1.0);
+}
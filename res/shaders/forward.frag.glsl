@@ -0,0 +1,57 @@
+#version 460
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex.glsl"
+#include "light.glsl"
+#include "shadow.glsl"
+#include "material.glsl"
+#include "shading.glsl"
+
+#define LIGHT_TILE_SET 3
+#include "lightTiles.glsl"
+
+layout (location = 0) in vec2 v_UV;
+layout (location = 1) in vec4 v_Colour;
+layout (location = 2) in vec3 v_Normal;
+layout (location = 3) in vec4 v_FragPos;
+layout (location = 4) in flat int v_MaterialIndex;
+
+layout (location = 0) out vec4 f_Colour;
+
+// Runs once per pixel after the depth prepass, lit by the tile's lights from the culling pass
+void main()
+{
+    vec4 position = v_FragPos;
+    vec3 norm = normalize(v_Normal);
+
+    vec3 albedo = vec3(1.0);
+    if (v_MaterialIndex == 0)
+    {
+        vec4 box = invGamma(texture(u_BoxSampler, v_UV));
+        vec4 face = invGamma(texture(u_FaceSampler, v_UV));
+        albedo = mix(box, face, 0.5).rgb;
+    }
+
+    MaterialData material = u_Materials.materials[v_MaterialIndex];
+
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+
+    // The mask pre-pass needs a G-buffer, so shadowMaskLights is 0 and this is never read
+    vec4 shadowMask[3] = vec4[3](vec4(1.0), vec4(1.0), vec4(1.0));
+
+    vec3 viewDir = normalize(PushConstants.cameraPos - position.xyz);
+
+    uint tile = lightTileIndex(uvec2(gl_FragCoord.xy));
+    uint tileLights = u_LightTiles.tiles[tile].count;
+
+    for (uint t = 0; t < tileLights; t++)
+    {
+        uint i = u_LightTiles.tiles[tile].indices[t];
+        addLight(u_Lights.lights[i], i, position, norm, viewDir, material.specular.a, shadowMask,
+                 diffuse, specular);
+    }
+
+    f_Colour = resolveColour(v_MaterialIndex, albedo, diffuse, specular);
+}
@@ -0,0 +1,134 @@
+// Reads the G-buffer in any layout. Include after vertex.glsl and light.glsl
+//
+// Full: position, normal and (uv, material index, coverage) in three targets
+// Compact: position from depth, an octahedral normal and (albedo, material index / 255)
+// Visibility: position from depth and the object and triangle index at binding 3, the surface
+// is rebuilt from the mesh through PushConstants
+//
+// Depth is bound whatever the layout, and forward rendering writes it too
+
+#include "octahedral.glsl"
+#include "visibility.glsl"
+
+#define OBJECT_SET 1
+#define OBJECT_BINDING 4
+#include "object.glsl"
+
+// Matches GBufferLayout
+const int GBUFFER_FULL = 0;
+const int GBUFFER_COMPACT = 1;
+const int GBUFFER_VISIBILITY = 2;
+
+layout(set=1, binding = 0) uniform sampler2D u_Position;
+layout(set=1, binding = 1) uniform sampler2D u_Normal;
+layout(set=1, binding = 2) uniform sampler2D u_TexData;
+layout(set=1, binding = 3) uniform usampler2D u_Visibility;
+layout(set=1, binding = 5) uniform sampler2D u_Depth;
+
+// World position from reverse-Z depth, using only the terms the camera's perspective has
+vec3 positionFromDepth(ivec2 pixel, float depth)
+{
+    mat4 proj = PushConstants.proj;
+    mat4 view = PushConstants.view;
+
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(u_Depth, 0)) * 2.0 - 1.0;
+    float viewZ = -proj[3][2] / (depth + proj[2][2]);
+    vec3 viewPos = vec3(ndc * -viewZ / vec2(proj[0][0], proj[1][1]), viewZ);
+
+    return transpose(mat3(view)) * (viewPos - view[3].xyz);
+}
+
+// Whether any geometry covers pixel, and its distance in front of the camera if so
+bool viewDepth(ivec2 pixel, out float distance)
+{
+    float depth = texelFetch(u_Depth, pixel, 0).r;
+    distance = PushConstants.proj[3][2] / (depth + PushConstants.proj[2][2]);
+    return depth > 0.0;
+}
+
+// Whether any geometry covers pixel, and its world position if so
+bool gBufferPosition(ivec2 pixel, out vec4 position)
+{
+    if (u_Lights.gBufferLayout != GBUFFER_FULL)
+    {
+        float depth = texelFetch(u_Depth, pixel, 0).r;
+        position = vec4(positionFromDepth(pixel, depth), 1.0);
+        return depth > 0.0;
+    }
+
+    position = texelFetch(u_Position, pixel, 0);
+    return texelFetch(u_TexData, pixel, 0).w >= 1.0;
+}
+
+// The triangle a visibility layout pixel sees, with its object
+struct VisibilityHit
+{
+    ObjectData object;
+    Vertex vertices[3];
+    vec3 barycentrics;
+};
+
+// Barycentrics come from intersecting the camera ray through the pixel's centre with the
+// triangle, which matches what the rasteriser covered without storing anything per pixel
+VisibilityHit visibilityHit(ivec2 pixel)
+{
+    uint visibility = texelFetch(u_Visibility, pixel, 0).r;
+    uint triangle = visibilityTriangle(visibility);
+
+    VisibilityHit hit;
+    hit.object = u_Models.objects[visibilityObject(visibility)];
+
+    vec3 corners[3];
+    for (int i = 0; i < 3; i++)
+    {
+        uint index = PushConstants.indexBuffer.indices[triangle * 3 + i];
+        hit.vertices[i] = PushConstants.vertexBuffer.vertices[index];
+        corners[i] = (hit.object.model * vec4(hit.vertices[i].position, 1.0)).xyz;
+    }
+
+    vec3 origin = PushConstants.cameraPos;
+    vec3 direction = positionFromDepth(pixel, 1.0) - origin;
+
+    vec3 edge1 = corners[1] - corners[0];
+    vec3 edge2 = corners[2] - corners[0];
+    vec3 p = cross(direction, edge2);
+    float determinant = dot(edge1, p);
+
+    // A triangle seen edge on covers next to nothing, any point of it will do
+    if (abs(determinant) < 1e-12)
+    {
+        hit.barycentrics = vec3(1.0 / 3.0);
+        return hit;
+    }
+
+    vec3 t = origin - corners[0];
+    float u = dot(t, p) / determinant;
+    float v = dot(direction, cross(t, edge1)) / determinant;
+    hit.barycentrics = vec3(1.0 - u - v, u, v);
+    return hit;
+}
+
+vec3 visibilityNormal(VisibilityHit hit)
+{
+    vec3 normal = hit.barycentrics.x * hit.vertices[0].normal +
+                  hit.barycentrics.y * hit.vertices[1].normal +
+                  hit.barycentrics.z * hit.vertices[2].normal;
+    return normalize(vec3(hit.object.rotation * vec4(normal, 1.0)));
+}
+
+vec2 visibilityUV(VisibilityHit hit)
+{
+    return hit.barycentrics.x * hit.vertices[0].UV + hit.barycentrics.y * hit.vertices[1].UV +
+           hit.barycentrics.z * hit.vertices[2].UV;
+}
+
+vec3 gBufferNormal(ivec2 pixel)
+{
+    if (u_Lights.gBufferLayout == GBUFFER_VISIBILITY)
+        return visibilityNormal(visibilityHit(pixel));
+
+    vec4 normal = texelFetch(u_Normal, pixel, 0);
+    if (u_Lights.gBufferLayout == GBUFFER_COMPACT)
+        return octahedralDecode(normal.xy);
+    return normalize(normal.xyz);
+}
@@ -1,19 +1,56 @@
+// Matches LightType
+const uint LIGHT_POINT = 0;
+const uint LIGHT_SPOT = 1;
+const uint LIGHT_DIRECTIONAL = 2;
+
+// LightData::shadowIndex of a light without shadow faces, matches NO_SHADOW
+const uint NO_SHADOW = 0xFFFFFFFFu;
+
 struct LightData
 {
     vec3 position;
-    mat4 model;
+    float radius;
     vec3 diffuse;
+    uint shadowIndex; // First of the light's u_ShadowFaces entries, six for point lights
     vec3 specular;
+    uint type;
     vec3 attenuation;
-    mat4 proj;
-    mat4 view[6];
+    float spotInnerCos;
+    vec3 direction;
+    float spotOuterCos;
+};
+
+struct ShadowFaceData
+{
+    mat4 viewProj;
+    vec4 rect; // Atlas UV offset in xy and scale in zw
 };
 
+// Size of the shadow face table, Engine::m_MaxShadowedLights point lights of six faces each
+const uint MAX_SHADOW_FACES = 60;
+
 layout (std430, set=0, binding=0) buffer readonly Lights
 {
     int lightCount;
+    int shadowMaskLights; // Leading lights whose shadows come from the half resolution mask
+    int gBufferLayout; // One of the GBUFFER_ constants in gbuffer.glsl
+    int lightTilesPerRow; // Width of the light tile grid, see lightTiles.glsl
     vec4 ambient;
     LightData lights[];
 } u_Lights;
 
-layout (set=0, binding=1) uniform sampler2DArray u_ShadowMaps;
+layout (std430, set=0, binding=2) buffer readonly ShadowFaces
+{
+    ShadowFaceData faces[];
+} u_ShadowFaces;
+
+// Unit vector from position towards the light
+vec3 lightDirection(LightData light, vec3 position)
+{
+    if (light.type == LIGHT_DIRECTIONAL)
+        return -normalize(light.direction);
+    return normalize(light.position - position);
+}
+
+// Comparison sampler over the shadow atlas, returns the lit fraction of the filter footprint
+layout (set=0, binding=1) uniform sampler2DShadow u_ShadowMaps;
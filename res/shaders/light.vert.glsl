@@ -12,9 +12,17 @@ void main()
     Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
 
     LightData data = u_Lights.lights[gl_InstanceIndex];
-    mat4 model = data.model;
 
-    gl_Position = PushConstants.proj * PushConstants.view * model * vec4(v.position, 1.0);
+    // A directional light has nowhere to draw its marker, a zero position is culled
+    if (data.type == LIGHT_DIRECTIONAL)
+    {
+        gl_Position = vec4(0.0);
+        v_Colour = vec4(0.0);
+        return;
+    }
+    vec3 position = data.position + 0.2 * v.position;
+
+    gl_Position = PushConstants.proj * PushConstants.view * vec4(position, 1.0);
 
     v_Colour = vec4(data.diffuse, 1.0);
 }
@@ -0,0 +1,101 @@
+#version 460
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#define LIGHT_TILE_SET 2
+
+#include "vertex.glsl"
+#include "light.glsl"
+#include "lightTiles.glsl"
+#include "gbuffer.glsl"
+
+layout (local_size_x = LIGHT_TILE_SIZE, local_size_y = LIGHT_TILE_SIZE) in;
+
+const uint THREADS = LIGHT_TILE_SIZE * LIGHT_TILE_SIZE;
+
+// View space depths are positive, so their bit patterns order the same way as the floats
+shared uint s_MinDepth;
+shared uint s_MaxDepth;
+shared uint s_Count;
+shared uint s_Indices[MAX_LIGHTS_PER_TILE];
+
+// View space plane through the eye on which clip space x (axis 0) or y (axis 1) is ndc * w,
+// facing towards side
+vec4 tilePlane(mat4 proj, int axis, float ndc, float side)
+{
+    vec4 row = vec4(proj[0][axis], proj[1][axis], proj[2][axis], proj[3][axis]);
+    vec4 w = vec4(proj[0][3], proj[1][3], proj[2][3], proj[3][3]);
+    vec4 plane = side * (row - ndc * w);
+    return plane / length(plane.xyz);
+}
+
+// One workgroup per tile. The tile's depth range comes from the depth buffer, then every light is
+// tested against the tile's side planes and that range
+void main()
+{
+    if (gl_LocalInvocationIndex == 0)
+    {
+        s_MinDepth = floatBitsToUint(3.402823e38);
+        s_MaxDepth = 0;
+        s_Count = 0;
+    }
+    barrier();
+
+    ivec2 size = textureSize(u_Depth, 0);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    float depth;
+    if (all(lessThan(pixel, size)) && viewDepth(pixel, depth))
+    {
+        atomicMin(s_MinDepth, floatBitsToUint(depth));
+        atomicMax(s_MaxDepth, floatBitsToUint(depth));
+    }
+    barrier();
+
+    float minDepth = uintBitsToFloat(s_MinDepth);
+    float maxDepth = uintBitsToFloat(s_MaxDepth);
+
+    vec2 ndcMin = vec2(gl_WorkGroupID.xy * LIGHT_TILE_SIZE) / vec2(size) * 2.0 - 1.0;
+    vec2 ndcMax = vec2((gl_WorkGroupID.xy + 1) * LIGHT_TILE_SIZE) / vec2(size) * 2.0 - 1.0;
+
+    vec4 planes[4] = vec4[4](tilePlane(PushConstants.proj, 0, ndcMin.x, 1.0),
+                             tilePlane(PushConstants.proj, 0, ndcMax.x, -1.0),
+                             tilePlane(PushConstants.proj, 1, ndcMin.y, 1.0),
+                             tilePlane(PushConstants.proj, 1, ndcMax.y, -1.0));
+
+    // A tile without geometry keeps an empty list, the lighting pass discards its pixels anyway
+    if (minDepth <= maxDepth)
+    {
+        for (uint i = gl_LocalInvocationIndex; i < uint(u_Lights.lightCount); i += THREADS)
+        {
+            LightData light = u_Lights.lights[i];
+
+            bool visible = true;
+            if (light.type != LIGHT_DIRECTIONAL)
+            {
+                vec3 centre = (PushConstants.view * vec4(light.position, 1.0)).xyz;
+                float radius = light.radius;
+
+                visible = -centre.z + radius >= minDepth && -centre.z - radius <= maxDepth;
+                for (int p = 0; p < 4 && visible; p++)
+                    visible = dot(planes[p].xyz, centre) + planes[p].w >= -radius;
+            }
+
+            // Lights past the list's capacity are dropped from this tile
+            if (visible)
+            {
+                uint slot = atomicAdd(s_Count, 1);
+                if (slot < MAX_LIGHTS_PER_TILE)
+                    s_Indices[slot] = i;
+            }
+        }
+    }
+    barrier();
+
+    uint tile = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = min(s_Count, MAX_LIGHTS_PER_TILE);
+
+    if (gl_LocalInvocationIndex == 0)
+        u_LightTiles.tiles[tile].count = count;
+    for (uint i = gl_LocalInvocationIndex; i < count; i += THREADS)
+        u_LightTiles.tiles[tile].indices[i] = s_Indices[i];
+}
@@ -0,0 +1,23 @@
+// Lights reaching each screen tile, written by lightCulling.comp.glsl. Include after light.glsl,
+// the includer defines LIGHT_TILE_SET. Matches Engine::m_LightTileSize and
+// Engine::m_MaxLightsPerTile
+const uint LIGHT_TILE_SIZE = 16;
+const uint MAX_LIGHTS_PER_TILE = 256;
+
+struct LightTile
+{
+    uint count;
+    uint indices[MAX_LIGHTS_PER_TILE]; // Into u_Lights.lights
+};
+
+layout (std430, set=LIGHT_TILE_SET, binding=0) buffer LightTiles
+{
+    LightTile tiles[];
+} u_LightTiles;
+
+// Tiles are stored row by row over the full resolution image
+uint lightTileIndex(uvec2 pixel)
+{
+    uvec2 tile = pixel / LIGHT_TILE_SIZE;
+    return tile.y * uint(u_Lights.lightTilesPerRow) + tile.x;
+}
@@ -0,0 +1,88 @@
+#version 460
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex.glsl"
+#include "light.glsl"
+
+// Filled by the whole workgroup before any pixel is shaded
+shared ShadowFaceData s_ShadowFaces[MAX_SHADOW_FACES];
+#define SHADOW_FACE(index) s_ShadowFaces[index]
+
+#include "shadow.glsl"
+#include "material.glsl"
+#include "gbuffer.glsl"
+#include "lighting.glsl"
+
+#define LIGHT_TILE_SET 4
+#include "lightTiles.glsl"
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout(set=5, binding = 0, rgba16f) uniform writeonly image2D u_DrawImage;
+
+const uint THREADS = 64;
+
+// Lights copied in full. Past this they are read from u_Lights, which keeps the shared memory
+// within the 16 KiB every device offers
+const uint SHARED_LIGHTS = 128;
+
+shared uint s_LightIndices[MAX_LIGHTS_PER_TILE];
+shared LightData s_Lights[SHARED_LIGHTS];
+
+// Each 8x8 group sits inside one culling tile, so its pixels share a light list. The list and
+// the shadow face table are loaded once per group instead of once per pixel
+void main()
+{
+    ivec2 size = textureSize(u_Position, 0);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+
+    uint tile = lightTileIndex(gl_WorkGroupID.xy * gl_WorkGroupSize.xy);
+    uint tileLights = u_LightTiles.tiles[tile].count;
+
+    for (uint t = gl_LocalInvocationIndex; t < tileLights; t += THREADS)
+    {
+        uint index = u_LightTiles.tiles[tile].indices[t];
+        s_LightIndices[t] = index;
+        if (t < SHARED_LIGHTS)
+            s_Lights[t] = u_Lights.lights[index];
+    }
+
+    for (uint f = gl_LocalInvocationIndex; f < MAX_SHADOW_FACES; f += THREADS)
+        s_ShadowFaces[f] = u_ShadowFaces.faces[f];
+
+    barrier();
+
+    if (any(greaterThanEqual(pixel, size)))
+        return;
+
+    vec4 position;
+    if (!gBufferPosition(pixel, position))
+        return;
+
+    vec3 norm;
+    vec3 albedo;
+    int materialIndex = gBufferSurface(pixel, norm, albedo);
+    MaterialData material = u_Materials.materials[materialIndex];
+
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+
+    vec3 cameraPos = PushConstants.cameraPos;
+
+    vec4 shadowMask[3];
+    if (u_Lights.shadowMaskLights > 0)
+        sampleShadowMask(vec2(pixel) + 0.5, position.xyz, cameraPos, shadowMask);
+
+    vec3 viewDir = normalize(cameraPos - position.xyz);
+
+    for (uint t = 0; t < tileLights; t++)
+    {
+        uint i = s_LightIndices[t];
+        LightData light = t < SHARED_LIGHTS ? s_Lights[t] : u_Lights.lights[i];
+        addLight(light, i, position, norm, viewDir, material.specular.a, shadowMask, diffuse,
+                 specular);
+    }
+
+    imageStore(u_DrawImage, pixel, resolveColour(materialIndex, albedo, diffuse, specular));
+}
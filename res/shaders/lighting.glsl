@@ -0,0 +1,91 @@
+// G-buffer side of the raster and compute deferred lighting passes. Include after light.glsl,
+// shadow.glsl, material.glsl and gbuffer.glsl
+
+#include "shading.glsl"
+
+// Four lights per image, written by shadowMask.frag.glsl
+layout(set=3, binding = 0) uniform sampler2D u_ShadowMask0;
+layout(set=3, binding = 1) uniform sampler2D u_ShadowMask1;
+layout(set=3, binding = 2) uniform sampler2D u_ShadowMask2;
+
+vec4 fetchShadowMask(int image, ivec2 texel)
+{
+    if (image == 0)
+        return texelFetch(u_ShadowMask0, texel, 0);
+    if (image == 1)
+        return texelFetch(u_ShadowMask1, texel, 0);
+    return texelFetch(u_ShadowMask2, texel, 0);
+}
+
+// Upsamples the half resolution mask. Each mask texel was evaluated at the top left pixel of its
+// 2x2 block, so the four nearest are blended bilinearly but weighted down when their pixel's
+// distance from the camera differs from this one's, which keeps shadows from bleeding across edges
+void sampleShadowMask(vec2 fragCoord, vec3 position, vec3 cameraPos, out vec4 mask[3])
+{
+    ivec2 maskSize = textureSize(u_ShadowMask0, 0);
+    vec2 coord = (fragCoord - 0.5) * 0.5;
+    ivec2 base = ivec2(floor(coord));
+    vec2 f = coord - vec2(base);
+
+    float distance = length(position - cameraPos);
+
+    mask = vec4[3](vec4(0.0), vec4(0.0), vec4(0.0));
+    float total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), maskSize - 1);
+
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        vec4 samplePosition;
+        gBufferPosition(texel * 2, samplePosition);
+        float difference = abs(length(samplePosition.xyz - cameraPos) - distance);
+        float weight = (bilinear.x * bilinear.y + 0.001) / (difference + 0.001);
+
+        for (int image = 0; image < 3; image++)
+            mask[image] += weight * fetchShadowMask(image, texel);
+        total += weight;
+    }
+
+    for (int image = 0; image < 3; image++)
+        mask[image] /= total;
+}
+
+// Normal, linear albedo and material index of a covered pixel. Textures have a single mip level,
+// so the full and visibility layouts sample them at level 0 the same as with derivatives
+int gBufferSurface(ivec2 pixel, out vec3 normal, out vec3 albedo)
+{
+    int materialIndex;
+    vec2 uv;
+    if (u_Lights.gBufferLayout == GBUFFER_VISIBILITY)
+    {
+        // One vertex fetch serves the normal and the texture coordinates
+        VisibilityHit hit = visibilityHit(pixel);
+        normal = visibilityNormal(hit);
+        materialIndex = hit.object.materialIndex;
+        uv = visibilityUV(hit);
+    }
+    else
+    {
+        normal = gBufferNormal(pixel);
+
+        vec4 texSample = texelFetch(u_TexData, pixel, 0);
+        if (u_Lights.gBufferLayout == GBUFFER_COMPACT)
+        {
+            albedo = texSample.rgb;
+            return int(round(texSample.a * 255.0));
+        }
+
+        materialIndex = int(texSample.z);
+        uv = texSample.xy;
+    }
+
+    albedo = vec3(1.0);
+    if (materialIndex == 0)
+    {
+        vec4 box = invGamma(textureLod(u_BoxSampler, uv, 0.0));
+        vec4 face = invGamma(textureLod(u_FaceSampler, uv, 0.0));
+        albedo = mix(box, face, 0.5).rgb;
+    }
+    return materialIndex;
+}
@@ -6,7 +6,13 @@ struct ObjectData
     mat4 rotation;
 };
 
-layout (std430, set=1, binding=0) buffer readonly Model
+// The G-buffer set carries its own binding of the object data, see gbuffer.glsl
+#ifndef OBJECT_SET
+#define OBJECT_SET 1
+#define OBJECT_BINDING 0
+#endif
+
+layout (std430, set=OBJECT_SET, binding=OBJECT_BINDING) buffer readonly Model
 {
     ObjectData objects[];
 } u_Models;
@@ -0,0 +1,62 @@
+// Light evaluation shared by every lighting path. Include after light.glsl, shadow.glsl and
+// material.glsl
+
+#include "colour.glsl"
+
+// Adds the diffuse and specular light reaching position from light, which is u_Lights.lights[i]
+void addLight(LightData light, uint i, vec4 position, vec3 norm, vec3 viewDir, float shininess,
+              vec4 shadowMask[3], inout vec3 diffuse, inout vec3 specular)
+{
+    vec3 lightPos = light.position;
+
+    float distance = length(lightPos - position.xyz);
+
+    // Past its radius a light has faded below the cutoff, so its shadow lookup is skipped too
+    if (light.type != LIGHT_DIRECTIONAL && distance > light.radius)
+        return;
+
+    float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * distance * distance);
+
+    vec3 lightDir = lightDirection(light, position.xyz);
+    if (light.type == LIGHT_DIRECTIONAL)
+    {
+        attenuation = 1.0;
+    }
+    else if (light.type == LIGHT_SPOT)
+    {
+        float theta = dot(lightDir, -normalize(light.direction));
+        attenuation *= smoothstep(light.spotOuterCos, light.spotInnerCos, theta);
+    }
+
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+
+    float diff = max(dot(norm, lightDir), 0.0);
+
+    float visibility = i < uint(u_Lights.shadowMaskLights)
+                           ? shadowMask[i / 4][i % 4]
+                           : shadowVisibility(light, position, norm, lightDir);
+
+    // Attenuation scales this light alone, not what earlier lights added
+    diffuse += light.diffuse * diff * visibility * attenuation;
+
+    float spec = pow(max(dot(viewDir, halfwayDir), 0.0), shininess);
+
+    specular += light.specular * spec * visibility * attenuation;
+}
+
+// Final display colour of a surface from the summed light
+vec4 resolveColour(int materialIndex, vec3 albedo, vec3 diffuse, vec3 specular)
+{
+    MaterialData material = u_Materials.materials[materialIndex];
+
+    vec3 colour = vec3(0);
+    vec3 ambient = u_Lights.ambient.rgb * material.ambient;
+
+    colour += ambient * material.ambient;
+    colour += diffuse * material.diffuse;
+    colour += specular * material.specular.rgb;
+
+    colour *= albedo;
+
+    return vec4(gammaCorrect(colour), 1.0);
+}
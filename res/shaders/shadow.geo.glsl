@@ -1,25 +1,34 @@
-#version 460 core
-#extension GL_GOOGLE_include_directive : require
+#version 450
 
-#include "light.glsl"
+// Matches MAX_SHADOW_VIEWPORTS in Engine.hpp
+const uint MAX_SHADOW_VIEWPORTS = 16;
 
 layout (triangles) in;
-layout (triangle_strip, max_vertices=18) out;
+layout (triangle_strip, max_vertices = 3) out;
 
-layout (location = 0) in flat int v_CurrentLight[3];
+layout (std430, push_constant) uniform constants
+{
+    layout (offset = 8) uint viewportFaces[MAX_SHADOW_VIEWPORTS];
+} PushConstants;
+
+layout (location = 0) in flat uint v_Face[3];
 
+// Fallback for devices without clip distances. The draw sets one viewport over each of its
+// faces' atlas tiles, every triangle goes to the viewport of the face its caster belongs to
 void main()
 {
-    LightData light = u_Lights.lights[v_CurrentLight[0]];
+    int viewport = 0;
+    for (int i = 0; i < MAX_SHADOW_VIEWPORTS; i++)
+    {
+        if (PushConstants.viewportFaces[i] == v_Face[0])
+            viewport = i;
+    }
 
-    for (int face = 0; face < 6; face++)
+    for (int i = 0; i < 3; i++)
     {
-        gl_Layer = v_CurrentLight[0] * 6 + face;
-        for (int i = 0; i < 3; i++)
-        {
-            gl_Position = light.proj * light.view[face] * gl_in[i].gl_Position;
-            EmitVertex();
-        }
-        EndPrimitive();
+        gl_ViewportIndex = viewport;
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
     }
+    EndPrimitive();
 }
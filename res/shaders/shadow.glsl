@@ -0,0 +1,56 @@
+// Where shadowVisibility reads the face table from, an includer may point it at a shared copy
+#ifndef SHADOW_FACE
+#define SHADOW_FACE(index) u_ShadowFaces.faces[index]
+#endif
+
+// Lights per mask image, one per channel, over the three images the engine creates
+const int SHADOW_MASK_LIGHTS = 12;
+
+// Cube face the direction from the light falls in, in the same order as the light's views
+int shadowFace(vec3 direction)
+{
+    vec3 magnitude = abs(direction);
+    if (magnitude.x >= magnitude.y && magnitude.x >= magnitude.z)
+        return direction.x > 0.0 ? 0 : 1;
+    if (magnitude.y >= magnitude.z)
+        return direction.y > 0.0 ? 2 : 3;
+    return direction.z > 0.0 ? 4 : 5;
+}
+
+// 1 when fully lit by the light, 0 when fully shadowed, in between along filtered edges
+float shadowVisibility(LightData light, vec4 fragPos, vec3 normal, vec3 lightDir)
+{
+    if (light.shadowIndex == NO_SHADOW)
+        return 1.0;
+
+    // Spot and directional lights have a single face
+    uint index = light.shadowIndex;
+    if (light.type == LIGHT_POINT)
+        index += shadowFace(fragPos.xyz - light.position);
+
+    ShadowFaceData face = SHADOW_FACE(index);
+
+    vec4 position = face.viewProj * fragPos;
+    vec3 projected = position.xyz / position.w; // [-1,1]
+
+    // Reverse-Z, so anything past the far plane has a negative depth
+    if (projected.z > 1.0 || projected.z < 0.0)
+        return 1.0;
+
+    float current = projected.z;
+    projected = projected * 0.5 + 0.5; // [0,1]
+
+    // Only a directional light's box or a spot's cone can miss, and only the box is lit outside
+    if (any(lessThan(projected.xy, vec2(0.0))) || any(greaterThan(projected.xy, vec2(1.0))))
+        return 1.0;
+
+    // Keep filtering inside this face's tile of the atlas
+    vec4 rect = face.rect;
+    vec2 halfTexel = 0.5 / vec2(textureSize(u_ShadowMaps, 0));
+    vec2 uv = clamp(rect.xy + projected.xy * rect.zw, rect.xy + halfTexel,
+                    rect.xy + rect.zw - halfTexel);
+
+    float bias = max(0.005 * 1.0 - dot(normal, lightDir), 0.0005);
+
+    return texture(u_ShadowMaps, vec3(uv, current + bias));
+}
@@ -4,6 +4,7 @@
 
 #include "object.glsl"
 #include "light.glsl"
+#include "shadowCaster.glsl"
 
 struct Vertex
 {
@@ -20,18 +21,22 @@ layout (buffer_reference, std430) readonly buffer VertexBuffer
 layout (std430, push_constant) uniform constants
 {
     VertexBuffer vertexBuffer;
-    ivec2 current;
 } PushConstants;
 
-layout (location = 0) out flat int v_CurrentLight;
+// Read by shadow.geo.glsl to pick the viewport
+layout (location = 0) out flat uint v_Face;
 
+// The viewport selects the face's atlas tile
 void main()
 {
     Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
 
-    ObjectData modelData = u_Models.objects[gl_InstanceIndex];
+    ShadowCaster caster = u_Casters.casters[gl_InstanceIndex];
+    ObjectData modelData = u_Models.objects[caster.object];
 
-    gl_Position = modelData.model * vec4(v.position, 1.0);
+    // Caster faces are numbered like the shadow face table
+    gl_Position = u_ShadowFaces.faces[caster.face].viewProj * modelData.model *
+                  vec4(v.position, 1.0);
 
-    v_CurrentLight = PushConstants.current.x;
+    v_Face = caster.face;
 }
@@ -0,0 +1,11 @@
+struct ShadowCaster
+{
+    uint object;
+    uint face; // Index into u_ShadowFaces
+};
+
+// Culled casters, one per shadow pass instance
+layout (std430, set=2, binding=0) buffer readonly Casters
+{
+    ShadowCaster casters[];
+} u_Casters;
@@ -0,0 +1,50 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "object.glsl"
+#include "light.glsl"
+#include "shadowCaster.glsl"
+
+struct Vertex
+{
+    vec3 position;
+    vec2 UV;
+    vec3 normal;
+};
+
+layout (buffer_reference, std430) readonly buffer VertexBuffer
+{
+    Vertex vertices[];
+};
+
+layout (std430, push_constant) uniform constants
+{
+    VertexBuffer vertexBuffer;
+} PushConstants;
+
+out float gl_ClipDistance[4];
+
+// One instance per culled caster of every dirty face, so the whole pass is a single draw
+void main()
+{
+    Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+
+    ShadowCaster caster = u_Casters.casters[gl_InstanceIndex];
+    ShadowFaceData face = u_ShadowFaces.faces[caster.face];
+
+    ObjectData modelData = u_Models.objects[caster.object];
+
+    vec4 clip = face.viewProj * modelData.model * vec4(v.position, 1.0);
+
+    // Clip to the face's own frustum, then squeeze it into its tile of the atlas
+    gl_ClipDistance[0] = clip.w - clip.x;
+    gl_ClipDistance[1] = clip.w + clip.x;
+    gl_ClipDistance[2] = clip.w - clip.y;
+    gl_ClipDistance[3] = clip.w + clip.y;
+
+    vec4 rect = face.rect;
+    clip.xy = ((clip.xy + clip.w) * 0.5 * rect.zw + rect.xy * clip.w) * 2.0 - clip.w;
+
+    gl_Position = clip;
+}
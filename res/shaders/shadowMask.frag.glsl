@@ -0,0 +1,48 @@
+#version 460
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex.glsl"
+#include "light.glsl"
+#include "shadow.glsl"
+#include "gbuffer.glsl"
+
+layout (location = 0) in vec3 v_CameraPos;
+layout (location = 1) in vec2 v_Texcoords;
+
+// Visibility of four lights each, one per channel
+layout (location = 0) out vec4 f_Mask0;
+layout (location = 1) out vec4 f_Mask1;
+layout (location = 2) out vec4 f_Mask2;
+
+// One texel per 2x2 block of the G-buffer, evaluated at the block's top left pixel
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) * 2;
+
+    float visibility[SHADOW_MASK_LIGHTS];
+    for (int i = 0; i < SHADOW_MASK_LIGHTS; i++)
+        visibility[i] = 1.0;
+
+    vec4 position;
+    if (gBufferPosition(pixel, position))
+    {
+        vec3 normal = gBufferNormal(pixel);
+
+        int count = min(u_Lights.shadowMaskLights, SHADOW_MASK_LIGHTS);
+        for (int i = 0; i < count; i++)
+        {
+            LightData light = u_Lights.lights[i];
+            float distance = length(light.position - position.xyz);
+            if (light.type != LIGHT_DIRECTIONAL && distance > light.radius)
+                continue;
+
+            vec3 lightDir = lightDirection(light, position.xyz);
+            visibility[i] = shadowVisibility(light, position, normal, lightDir);
+        }
+    }
+
+    f_Mask0 = vec4(visibility[0], visibility[1], visibility[2], visibility[3]);
+    f_Mask1 = vec4(visibility[4], visibility[5], visibility[6], visibility[7]);
+    f_Mask2 = vec4(visibility[8], visibility[9], visibility[10], visibility[11]);
+}
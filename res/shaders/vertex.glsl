@@ -10,10 +10,16 @@ layout (buffer_reference, std430) readonly buffer VertexBuffer
     Vertex vertices[];
 };
 
+layout (buffer_reference, std430) readonly buffer IndexBuffer
+{
+    uint indices[];
+};
+
 layout (push_constant) uniform constants
 {
     mat4 view;
     mat4 proj;
     vec3 cameraPos;
     VertexBuffer vertexBuffer;
+    IndexBuffer indexBuffer;
 } PushConstants;
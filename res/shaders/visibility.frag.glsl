@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "visibility.glsl"
+
+layout (location = 0) in flat uint v_Object;
+layout (location = 1) in flat uint v_Triangle;
+
+layout (location = 0) out uint f_Visibility;
+
+void main()
+{
+    f_Visibility = packVisibility(v_Object, v_Triangle);
+}
@@ -0,0 +1,19 @@
+// Packing of the visibility buffer, object index + 1 over the triangle index, so zero is left for
+// pixels nothing covers. Meshes can have up to 4096 triangles and scenes about a million objects
+const uint VISIBILITY_TRIANGLE_BITS = 12;
+const uint VISIBILITY_TRIANGLE_MASK = (1u << VISIBILITY_TRIANGLE_BITS) - 1u;
+
+uint packVisibility(uint object, uint triangle)
+{
+    return ((object + 1u) << VISIBILITY_TRIANGLE_BITS) | triangle;
+}
+
+uint visibilityObject(uint visibility)
+{
+    return (visibility >> VISIBILITY_TRIANGLE_BITS) - 1u;
+}
+
+uint visibilityTriangle(uint visibility)
+{
+    return visibility & VISIBILITY_TRIANGLE_MASK;
+}
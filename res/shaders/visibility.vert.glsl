@@ -0,0 +1,24 @@
+#version 450
+
+#extension GL_EXT_buffer_reference : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex.glsl"
+#include "object.glsl"
+
+layout (location = 0) out flat uint v_Object;
+layout (location = 1) out flat uint v_Triangle;
+
+// Drawn without an index buffer, so gl_VertexIndex counts through the mesh's indices and every
+// three of them make a triangle
+void main()
+{
+    uint index = PushConstants.indexBuffer.indices[gl_VertexIndex];
+    Vertex v = PushConstants.vertexBuffer.vertices[index];
+
+    mat4 model = u_Models.objects[gl_InstanceIndex].model;
+    gl_Position = PushConstants.proj * PushConstants.view * model * vec4(v.position, 1.0);
+
+    v_Object = gl_InstanceIndex;
+    v_Triangle = gl_VertexIndex / 3;
+}
@@ -1,6 +1,7 @@
 #include "Buffer.hpp"
 
 #include "ErrorCheck.hpp"
+#include "UploadBatch.hpp"
 
 void AllocatedBuffer::createBuffer(VmaAllocator allocator, size_t allocSize,
                                    VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
@@ -32,15 +33,8 @@ void AllocatedBuffer::destroyBuffer(VmaAllocator allocator)
     m_Init = false;
 }
 
-void AllocatedBuffer::pushFromBuffer(VmaAllocator allocator, const AllocatedBuffer& buffer,
-                                     size_t size)
+void AllocatedBuffer::pushBytes(UploadBatch& batch, const void* data, size_t size,
+                                size_t dstOffset)
 {
-    ImmediateSubmit::submit([&](VkCommandBuffer cmd) {
-        VkBufferCopy copy{};
-        copy.srcOffset = 0;
-        copy.dstOffset = 0;
-        copy.size = size;
-
-        vkCmdCopyBuffer(cmd, buffer.buffer, this->buffer, 1, &copy);
-    });
+    batch.copyToBuffer(buffer, data, size, dstOffset);
 }
@@ -6,7 +6,7 @@
 
 #include <span>
 
-#include "ImmediateSubmit.hpp"
+class UploadBatch;
 
 class AllocatedBuffer
 {
@@ -21,28 +21,13 @@ class AllocatedBuffer
 
     void destroyBuffer(VmaAllocator allocator);
 
-    void pushFromBuffer(VmaAllocator allocator, const AllocatedBuffer& buffer, size_t size);
+    // Staged into the batch's arena immediately; visible once the batch's ticket completes
+    void pushBytes(UploadBatch& batch, const void* data, size_t size, size_t dstOffset = 0);
 
     template<typename T>
-    void pushData(VmaAllocator allocator, const std::span<T>& data)
+    void pushData(UploadBatch& batch, const std::span<T>& data)
     {
-        size_t size = data.size() * sizeof(T);
-        AllocatedBuffer stagingBuffer;
-        stagingBuffer.createBuffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                   VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-        memcpy(stagingBuffer.allocationInfo.pMappedData, data.data(), size);
-
-        ImmediateSubmit::submit([&](VkCommandBuffer cmd) {
-            VkBufferCopy copy{};
-            copy.srcOffset = 0;
-            copy.dstOffset = 0;
-            copy.size = size;
-
-            vkCmdCopyBuffer(cmd, stagingBuffer.buffer, buffer, 1, &copy);
-        });
-
-        stagingBuffer.destroyBuffer(allocator);
+        pushBytes(batch, data.data(), data.size() * sizeof(T));
     }
 
   private:
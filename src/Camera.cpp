@@ -39,6 +39,18 @@ void Camera::update(double dt)
     // std::cout << std::format("{} | {}\n", m_Pitch, m_Yaw);
 }
 
+void Camera::lookAt(glm::vec3 position, glm::vec3 target)
+{
+    glm::vec3 front = glm::normalize(target - position);
+
+    // Inverse of updateVectors()
+    m_Position = position;
+    m_Pitch = glm::degrees(asin(std::clamp(front.y, -1.0f, 1.0f)));
+    m_Yaw = -glm::degrees(atan2(front.z, front.x)) - 90.0f;
+
+    updateVectors();
+}
+
 void Camera::receiveEvent(const Event* event)
 {
     switch (event->getType())
@@ -18,6 +18,9 @@ class Camera : public EventObserver
 
     void update(double dt);
 
+    // Places the camera at position facing target, replacing any mouse-driven orientation
+    void lookAt(glm::vec3 position, glm::vec3 target);
+
     virtual void receiveEvent(const Event* event) override;
 
     glm::mat4 getView();
@@ -0,0 +1,144 @@
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+
+std::mutex CpuProfiler::m_RingsMutex;
+std::vector<std::unique_ptr<CpuProfiler::ThreadRing>> CpuProfiler::m_Rings;
+
+// Zone and thread names are mostly literals, but nothing stops one holding a quote
+static std::string escapeJson(std::string_view text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+            escaped += std::format("\\u{:04x}", static_cast<int>(c));
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+int64_t CpuProfiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void CpuProfiler::record(const char* name, int64_t beginNs, int64_t endNs)
+{
+    ThreadRing& ring = getThreadRing();
+
+    // Only the owning thread writes. The slot is marked as being written before its fields
+    // change, and the release store of its sequence publishes them
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    EventSlot& slot = ring.events[head % m_RingSize];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.beginNs.store(beginNs, std::memory_order_relaxed);
+    slot.endNs.store(endNs, std::memory_order_relaxed);
+
+    slot.sequence.store(head + 1, std::memory_order_release);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::setThreadName(const char* name)
+{
+    ThreadRing& ring = getThreadRing();
+
+    std::lock_guard<std::mutex> lock(m_RingsMutex);
+    ring.threadName = name;
+}
+
+void CpuProfiler::writeChromeTrace(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(m_RingsMutex);
+
+    out << "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [";
+
+    bool first = true;
+    auto separator = [&first]() {
+        const char* separator = first ? "\n    " : ",\n    ";
+        first = false;
+        return separator;
+    };
+
+    std::vector<CpuZoneEvent> events;
+    for (const std::unique_ptr<ThreadRing>& ring : m_Rings)
+    {
+        if (!ring->threadName.empty())
+        {
+            out << std::format("{}{{ \"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 0, "
+                               "\"tid\": {}, \"args\": {{ \"name\": \"{}\" }} }}",
+                               separator(), ring->threadId, escapeJson(ring->threadName));
+        }
+
+        // Copy what the writer has published. A slot is kept only if it still holds the same
+        // event after the copy, otherwise the writer has started overwriting it
+        uint64_t end = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = end > m_RingSize ? end - m_RingSize : 0;
+
+        events.clear();
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const EventSlot& slot = ring->events[i % m_RingSize];
+            if (slot.sequence.load(std::memory_order_acquire) != i + 1) continue;
+
+            CpuZoneEvent event = { .name = slot.name.load(std::memory_order_relaxed),
+                                   .beginNs = slot.beginNs.load(std::memory_order_relaxed),
+                                   .endNs = slot.endNs.load(std::memory_order_relaxed) };
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != i + 1) continue;
+
+            events.push_back(event);
+        }
+
+        for (const CpuZoneEvent& event : events)
+        {
+            out << std::format("{}{{ \"ph\": \"X\", \"cat\": \"cpu\", \"name\": \"{}\", "
+                               "\"pid\": 0, \"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f} }}",
+                               separator(), escapeJson(event.name), ring->threadId,
+                               event.beginNs * 1e-3, (event.endNs - event.beginNs) * 1e-3);
+        }
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+void CpuProfiler::writeChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file) throw std::runtime_error(std::format("Failed to open {}", path));
+
+    writeChromeTrace(file);
+}
+
+CpuProfiler::ThreadRing& CpuProfiler::getThreadRing()
+{
+    thread_local ThreadRing* threadRing = nullptr;
+    if (threadRing) return *threadRing;
+
+    // Rings are kept after their thread exits so its zones can still be exported
+    std::lock_guard<std::mutex> lock(m_RingsMutex);
+
+    m_Rings.push_back(std::make_unique<ThreadRing>());
+    threadRing = m_Rings.back().get();
+    threadRing->threadId = static_cast<uint32_t>(m_Rings.size());
+
+    return *threadRing;
+}
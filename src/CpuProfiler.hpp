@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Zones are only recorded when built with ENABLE_PROFILING, otherwise the macros expand to nothing
+#ifdef ENABLE_PROFILING
+    #define PROFILE_CONCAT_INNER(a, b) a##b
+    #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+    #define PROFILE_ZONE(name) CpuZone PROFILE_CONCAT(cpuZone, __LINE__)(name)
+    #define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+    #define PROFILE_THREAD_NAME(name) CpuProfiler::setThreadName(name)
+#else
+    #define PROFILE_ZONE(name)
+    #define PROFILE_FUNCTION()
+    #define PROFILE_THREAD_NAME(name)
+#endif
+
+struct CpuZoneEvent {
+    // Must outlive the profiler, zone names are expected to be literals
+    const char* name;
+    int64_t beginNs;
+    int64_t endNs;
+};
+
+// Each thread appends completed zones to its own ring, so recording never takes a lock. Once a
+// ring is full the oldest zones are overwritten. Rings can be exported while their threads are
+// still recording, slots being rewritten are skipped
+class CpuProfiler
+{
+  public:
+    // Nanoseconds on std::chrono::steady_clock
+    static int64_t now();
+
+    static void record(const char* name, int64_t beginNs, int64_t endNs);
+
+    static void setThreadName(const char* name);
+
+    // Chrome trace event format, loadable in chrome://tracing and Perfetto
+    static void writeChromeTrace(std::ostream& out);
+    static void writeChromeTrace(const std::string& path);
+
+  private:
+    static constexpr size_t m_RingSize = 1 << 16;
+
+    // Fields are atomic so an export can read a slot while its thread rewrites it. sequence is
+    // the event's index + 1 once published and 0 while it is being written
+    struct EventSlot {
+        std::atomic<uint64_t> sequence = 0;
+        std::atomic<const char*> name = nullptr;
+        std::atomic<int64_t> beginNs = 0;
+        std::atomic<int64_t> endNs = 0;
+    };
+
+    struct ThreadRing {
+        uint32_t threadId;
+        std::string threadName;
+
+        std::atomic<uint64_t> head = 0;
+        std::array<EventSlot, m_RingSize> events;
+    };
+
+    static ThreadRing& getThreadRing();
+
+  private:
+    static std::mutex m_RingsMutex;
+    static std::vector<std::unique_ptr<ThreadRing>> m_Rings;
+};
+
+class CpuZone
+{
+  public:
+    CpuZone(const char* name) : m_Name{ name }, m_Begin{ CpuProfiler::now() } {}
+    ~CpuZone() { CpuProfiler::record(m_Name, m_Begin, CpuProfiler::now()); }
+
+    CpuZone(const CpuZone&) = delete;
+    CpuZone& operator=(const CpuZone&) = delete;
+
+  private:
+    const char* m_Name;
+    int64_t m_Begin;
+};
@@ -1,5 +1,6 @@
 #include "Descriptors.hpp"
 
+#include "CpuProfiler.hpp"
 #include "ErrorCheck.hpp"
 
 DescriptorLayoutBuilder DescriptorLayoutBuilder::start(VkDevice device)
@@ -33,6 +34,14 @@ DescriptorLayoutBuilder& DescriptorLayoutBuilder::addStorageBuffer(uint32_t bind
     return *this;
 }
 
+DescriptorLayoutBuilder&
+DescriptorLayoutBuilder::addDynamicStorageBuffer(uint32_t binding, VkShaderStageFlags shaderStages)
+{
+    addBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, shaderStages);
+
+    return *this;
+}
+
 DescriptorLayoutBuilder& DescriptorLayoutBuilder::addStorageImage(uint32_t binding,
                                                                   VkShaderStageFlags shaderStages)
 {
@@ -51,6 +60,8 @@ DescriptorLayoutBuilder::addCombinedImageSampler(uint32_t binding, VkShaderStage
 
 VkDescriptorSetLayout DescriptorLayoutBuilder::build()
 {
+    PROFILE_FUNCTION();
+
     VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
     descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(m_Bindings.size());
@@ -160,6 +171,23 @@ DescriptorSetBuilder& DescriptorSetBuilder::addStorageBuffer(uint32_t binding, V
     return *this;
 }
 
+DescriptorSetBuilder& DescriptorSetBuilder::addDynamicStorageBuffer(uint32_t binding,
+                                                                    VkBuffer buffer, size_t range)
+{
+    m_BufferInfos.push_back(VkDescriptorBufferInfo{ .buffer = buffer, .offset = 0, .range = range });
+
+    m_DescriptorWrites[-1].push_back(
+        VkWriteDescriptorSet{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                              .dstBinding = binding,
+                              .dstArrayElement = 0,
+                              .descriptorCount = 1,
+                              .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                              .pImageInfo = nullptr,
+                              .pBufferInfo = (VkDescriptorBufferInfo*)m_BufferInfos.size(),
+                              .pTexelBufferView = nullptr });
+    return *this;
+}
+
 DescriptorSetBuilder& DescriptorSetBuilder::addStorageBuffers(uint32_t binding,
                                                               const std::span<VkBuffer>& buffers,
                                                               uint32_t offset, size_t range)
@@ -208,6 +236,8 @@ DescriptorSetBuilder::addStorageBuffers(uint32_t binding, const std::span<Alloca
 
 std::vector<VkDescriptorSet> DescriptorSetBuilder::build()
 {
+    PROFILE_FUNCTION();
+
     for (size_t i = 0; i < m_Sets; i++)
     {
         std::vector<VkWriteDescriptorSet> sets = m_DescriptorWrites[-1];
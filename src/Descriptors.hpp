@@ -17,6 +17,8 @@ class DescriptorLayoutBuilder
                                         VkShaderStageFlags shaderStages);
 
     DescriptorLayoutBuilder& addStorageBuffer(uint32_t binding, VkShaderStageFlags shaderStages);
+    DescriptorLayoutBuilder& addDynamicStorageBuffer(uint32_t binding,
+                                                     VkShaderStageFlags shaderStages);
     DescriptorLayoutBuilder& addStorageImage(uint32_t binding, VkShaderStageFlags shaderStages);
     DescriptorLayoutBuilder& addCombinedImageSampler(uint32_t binding,
                                                      VkShaderStageFlags shaderStages);
@@ -53,6 +55,7 @@ class DescriptorSetBuilder
 
     DescriptorSetBuilder& addStorageBuffer(uint32_t binding, VkBuffer buffer, uint32_t offset,
                                            size_t range);
+    DescriptorSetBuilder& addDynamicStorageBuffer(uint32_t binding, VkBuffer buffer, size_t range);
 
     DescriptorSetBuilder& addStorageBuffers(uint32_t binding, const std::span<VkBuffer>& buffer,
                                             uint32_t offset, size_t range);
@@ -1,55 +1,87 @@
 #include "Engine.hpp"
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <random>
+#include <thread>
 
 #include <VkBootstrap.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "CpuProfiler.hpp"
 #include "ErrorCheck.hpp"
 #include "Image.hpp"
 #include "Pipeline.hpp"
 
-Engine::Engine()
+Engine::Engine(const EngineConfig& config) : m_Config{ config }
 {
-    m_Window = std::make_unique<Window>();
-    m_Window->init("LearnOpenGL-Vulkan", { 800, 800 });
+    if (m_Config.framesInFlight < 1 || m_Config.framesInFlight > MAX_FRAMES_IN_FLIGHT)
+    {
+        throw std::runtime_error(std::format("framesInFlight must be between 1 and {}, got {}",
+                                             MAX_FRAMES_IN_FLIGHT, m_Config.framesInFlight));
+    }
+    m_Frames.resize(m_Config.framesInFlight);
 
     m_Camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f), 0.0f, 0.0f);
 
-    m_Window->attachObserver(this);
-    m_Window->attachObserver(&m_Camera);
+    if (!m_Config.headless)
+    {
+        m_Window = std::make_unique<Window>();
+        m_Window->init("LearnOpenGL-Vulkan",
+                       { (int)m_Config.extent.width, (int)m_Config.extent.height });
+
+        m_Window->attachObserver(this);
+        m_Window->attachObserver(&m_Camera);
+    }
+
+    uint32_t workerThreads = m_Config.workerThreads;
+    if (workerThreads == 0) workerThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    m_Jobs.create(workerThreads);
 
     initVulkan();
     initSwapchain();
     initCommands();
     initSyncStructures();
 
-    ImmediateSubmit::init(m_Device, m_GraphicsQueue, m_GraphicsQueueFamily);
+    m_GpuProfiler.create(m_Instance, m_Device, m_PhysicalDevice, m_GraphicsQueueFamily,
+                         static_cast<uint32_t>(m_Frames.size()), m_CalibratedTimestamps);
+
+    UploadManager::init(m_Device, m_GraphicsQueue, m_GraphicsQueueFamily, m_TransferQueue,
+                        m_TransferQueueFamily);
+    m_StagingArena.create(m_Allocator, m_StagingChunkSize);
+
+    // All startup assets go out in one submission
+    UploadBatch uploads = UploadBatch::start(m_StagingArena);
 
     initDescriptorSetLayouts();
 
     initPipelines();
 
-    initTextures();
+    initTextures(uploads);
 
     createMaterials();
     createObjects();
     createLights();
 
+    initFrameData();
+
     initDescriptorPool();
     initDescriptorSets();
 
-    createMesh();
+    createMesh(uploads);
 
-    mainLoop();
+    uploads.flush();
 }
 
 Engine::~Engine()
 {
     vkDeviceWaitIdle(m_Device);
     cleanup();
+
+    m_Jobs.destroy();
 }
 
 void Engine::receiveEvent(const Event* event)
@@ -58,6 +90,18 @@ void Engine::receiveEvent(const Event* event)
     {
     case EventType::KEYBOARD_PRESS:
         {
+            const KeyboardPressEvent* kpEvent = reinterpret_cast<const KeyboardPressEvent*>(event);
+
+            if (kpEvent->keyType == GLFW_KEY_F12 && kpEvent->keyAction == GLFW_PRESS)
+                CpuProfiler::writeChromeTrace("cpu_trace.json");
+
+            if (kpEvent->keyType == GLFW_KEY_F10 && kpEvent->keyAction == GLFW_PRESS)
+                setComputeLighting(!m_Config.computeLighting);
+
+            if (kpEvent->keyType == GLFW_KEY_F11 && kpEvent->keyAction == GLFW_PRESS)
+                setRenderPath(m_Config.renderPath == RenderPath::Deferred ? RenderPath::ForwardPlus
+                                                                          : RenderPath::Deferred);
+
             break;
         }
     default:
@@ -69,21 +113,21 @@ void Engine::cleanup()
 {
     m_BasicMesh.destroyMesh(m_Allocator);
 
-    ImmediateSubmit::free();
+    UploadManager::free();
+    m_StagingArena.destroy();
 
     vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_DrawImageDescriptorLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_LightTileDescriptorLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_ShadowMaskDescriptorLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_ShadowCasterDescriptorLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_Device, m_MaterialDescriptorLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_Device, m_LightDescriptorLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_Device, m_ObjectDescriptorLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_Device, m_GBufferDescriptorLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_Device, m_DummySetLayout, nullptr);
 
-    for (size_t i = 0; i < m_ObjectDataBuffer.size(); i++)
-    {
-        m_LightDataBuffer[i].destroyBuffer(m_Allocator);
-        m_ObjectDataBuffer[i].destroyBuffer(m_Allocator);
-        m_MaterialDataBuffer[i].destroyBuffer(m_Allocator);
-    }
+    m_FrameDataRing.destroy(m_Allocator);
 
     m_FaceTexture.destroy(m_Device, m_Allocator);
     m_BoxTexture.destroy(m_Device, m_Allocator);
@@ -91,39 +135,62 @@ void Engine::cleanup()
     vkDestroyPipeline(m_Device, m_LightDrawPipeline, nullptr);
     vkDestroyPipelineLayout(m_Device, m_LightDrawPipelineLayout, nullptr);
 
+    vkDestroyPipeline(m_Device, m_ForwardPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_ForwardPipelineLayout, nullptr);
+
     vkDestroyPipeline(m_Device, m_SceneRenderPipeline, nullptr);
     vkDestroyPipelineLayout(m_Device, m_SceneRenderPipelineLayout, nullptr);
 
+    vkDestroyPipeline(m_Device, m_LightingComputePipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_LightingComputePipelineLayout, nullptr);
+
+    vkDestroyPipeline(m_Device, m_LightCullingPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_LightCullingPipelineLayout, nullptr);
+
+    vkDestroyPipeline(m_Device, m_ShadowMaskPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_ShadowMaskPipelineLayout, nullptr);
+
     vkDestroyPipeline(m_Device, m_DeferredRenderPipeline, nullptr);
     vkDestroyPipelineLayout(m_Device, m_DeferredRenderPipelineLayout, nullptr);
 
+    vkDestroyPipeline(m_Device, m_DepthPrepassPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_DepthPrepassPipelineLayout, nullptr);
+
     vkDestroyPipeline(m_Device, m_ShadowMapPipeline, nullptr);
     vkDestroyPipelineLayout(m_Device, m_ShadowMapPipelineLayout, nullptr);
 
     for (size_t i = 0; i < m_Frames.size(); i++)
     {
-        vkDestroySemaphore(m_Device, m_Frames[i].renderSemaphore, nullptr);
         vkDestroySemaphore(m_Device, m_Frames[i].swapchainSemaphore, nullptr);
-        vkDestroyFence(m_Device, m_Frames[i].renderFence, nullptr);
+
+        for (ThreadCommandPool& threadPool : m_Frames[i].threadPools)
+            vkDestroyCommandPool(m_Device, threadPool.commandPool, nullptr);
 
         vkDestroyCommandPool(m_Device, m_Frames[i].commandPool, nullptr);
     }
+    vkDestroySemaphore(m_Device, m_FrameTimeline, nullptr);
+
+    m_GpuProfiler.destroy();
 
     m_DrawImage.destroy(m_Device, m_Allocator);
     m_DepthImage.destroy(m_Device, m_Allocator);
-    m_ShadowMaps.destroy(m_Device, m_Allocator);
+    m_ShadowAtlas.destroy(m_Device, m_Allocator);
+
+    for (AllocatedImage& mask : m_ShadowMask)
+        mask.destroy(m_Device, m_Allocator);
 
-    m_GBuffer.texData.destroy(m_Device, m_Allocator);
-    m_GBuffer.normal.destroy(m_Device, m_Allocator);
-    m_GBuffer.position.destroy(m_Device, m_Allocator);
+    m_LightTiles.destroyBuffer(m_Allocator);
 
-    destroySwapchain();
+    for (AllocatedImage* target : getGBufferTargets())
+        target->destroy(m_Device, m_Allocator);
+
+    if (!m_Config.headless) destroySwapchain();
 
     vmaDestroyAllocator(m_Allocator);
 
     vkDestroyDevice(m_Device, nullptr);
 
-    vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
+    if (!m_Config.headless) vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
 
     vkb::destroy_debug_utils_messenger(m_Instance, m_DebugMessenger);
     vkDestroyInstance(m_Instance, nullptr);
@@ -136,13 +203,14 @@ void Engine::initVulkan()
                        .request_validation_layers(true)
                        .use_default_debug_messenger()
                        .require_api_version(1, 3, 0)
+                       .set_headless(m_Config.headless)
                        .build();
 
     vkb::Instance vkbInst = instRet.value();
     m_Instance = vkbInst.instance;
     m_DebugMessenger = vkbInst.debug_messenger;
 
-    m_Surface = m_Window->getSurface(m_Instance);
+    m_Surface = m_Config.headless ? VK_NULL_HANDLE : m_Window->getSurface(m_Instance);
 
     VkPhysicalDeviceVulkan13Features features13{};
     features13.dynamicRendering = true;
@@ -151,6 +219,7 @@ void Engine::initVulkan()
     VkPhysicalDeviceVulkan12Features features12{};
     features12.bufferDeviceAddress = true;
     features12.descriptorIndexing = true;
+    features12.timelineSemaphore = true;
 
     VkPhysicalDeviceVulkan11Features features11{};
     features11.shaderDrawParameters = true;
@@ -159,16 +228,18 @@ void Engine::initVulkan()
     features.robustBufferAccess = true;
     features.fragmentStoresAndAtomics = true;
     features.imageCubeArray = true;
-    features.geometryShader = true;
 
     vkb::PhysicalDeviceSelector selector{ vkbInst };
-    auto vkbMaybeDevice = selector.set_minimum_version(1, 3)
-                              .set_required_features_13(features13)
-                              .set_required_features_12(features12)
-                              .set_required_features_11(features11)
-                              .set_required_features(features)
-                              .set_surface(m_Surface)
-                              .select();
+    selector.set_minimum_version(1, 3)
+        .set_required_features_13(features13)
+        .set_required_features_12(features12)
+        .set_required_features_11(features11)
+        .set_required_features(features);
+
+    // A headless instance neither needs a surface nor requires swapchain support
+    if (!m_Config.headless) selector.set_surface(m_Surface);
+
+    auto vkbMaybeDevice = selector.select();
 
     if (!vkbMaybeDevice.has_value())
     {
@@ -178,6 +249,30 @@ void Engine::initVulkan()
 
     vkb::PhysicalDevice vkbPhysicalDevice = vkbMaybeDevice.value();
 
+    // Lets GPU timestamps be placed on the CPU timeline
+    m_CalibratedTimestamps =
+        vkbPhysicalDevice.enable_extension_if_present(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+    // Clip distances keep each instanced shadow face inside its atlas tile, without them the faces
+    // go to their own viewports, through a geometry shader or a draw per face
+    if (!m_Config.perFaceShadowDraws && !m_Config.geometryShaderShadows)
+    {
+        VkPhysicalDeviceFeatures clipFeatures{};
+        clipFeatures.shaderClipDistance = true;
+        m_InstancedShadows = vkbPhysicalDevice.enable_features_if_present(clipFeatures);
+    }
+
+    // A geometry shader covers up to m_ShadowViewportCount faces per draw
+    if (!m_Config.perFaceShadowDraws && !m_InstancedShadows)
+    {
+        VkPhysicalDeviceFeatures viewportFeatures{};
+        viewportFeatures.geometryShader = true;
+        viewportFeatures.multiViewport = true;
+        m_GeometryShadows = vkbPhysicalDevice.enable_features_if_present(viewportFeatures);
+        m_ShadowViewportCount =
+            std::min(vkbPhysicalDevice.properties.limits.maxViewports, MAX_SHADOW_VIEWPORTS);
+    }
+
     vkb::DeviceBuilder deviceBuilder{ vkbPhysicalDevice };
     vkb::Device vkbDevice = deviceBuilder.build().value();
 
@@ -187,6 +282,26 @@ void Engine::initVulkan()
     m_GraphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
     m_GraphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+    // Prefer a transfer-only family (usually the DMA engine), then any queue separate from
+    // graphics, then share the graphics queue
+    if (auto dedicated = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+        dedicated.has_value())
+    {
+        m_TransferQueue = dedicated.value();
+        m_TransferQueueFamily =
+            vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+    }
+    else if (auto separate = vkbDevice.get_queue(vkb::QueueType::transfer); separate.has_value())
+    {
+        m_TransferQueue = separate.value();
+        m_TransferQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::transfer).value();
+    }
+    else
+    {
+        m_TransferQueue = m_GraphicsQueue;
+        m_TransferQueueFamily = m_GraphicsQueueFamily;
+    }
+
     VmaAllocatorCreateInfo allocatorCI{};
     allocatorCI.physicalDevice = m_PhysicalDevice;
     allocatorCI.device = m_Device;
@@ -202,10 +317,12 @@ void Engine::destroySwapchain()
     for (size_t i = 0; i < m_SwapchainImageViews.size(); i++)
     {
         vkDestroyImageView(m_Device, m_SwapchainImageViews[i], nullptr);
+        vkDestroySemaphore(m_Device, m_PresentSemaphores[i], nullptr);
     }
 
     m_SwapchainImages.clear();
     m_SwapchainImageViews.clear();
+    m_PresentSemaphores.clear();
 }
 
 void Engine::createSwapchain()
@@ -219,7 +336,7 @@ void Engine::createSwapchain()
             .set_desired_format({ .format = m_SwapchainImageFormat,
                                   .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
             .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
-            .set_desired_extent(m_Window->getSize().x, m_Window->getSize().y)
+            .set_desired_extent(m_Config.extent.width, m_Config.extent.height)
             .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
             .build()
             .value();
@@ -228,80 +345,99 @@ void Engine::createSwapchain()
     m_SwapchainImageExtent = vkbSwapchain.extent;
     m_SwapchainImages = vkbSwapchain.get_images().value();
     m_SwapchainImageViews = vkbSwapchain.get_image_views().value();
+
+    // Presentation needs binary semaphores, and one can only be reused once the image it was
+    // signalled for has been acquired again, so they belong to the image rather than the frame
+    VkSemaphoreCreateInfo semaphoreCI{};
+    semaphoreCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCI.pNext = nullptr;
+
+    m_PresentSemaphores.resize(m_SwapchainImages.size());
+    for (size_t i = 0; i < m_PresentSemaphores.size(); i++)
+    {
+        VK_CHECK(vkCreateSemaphore(m_Device, &semaphoreCI, nullptr, &m_PresentSemaphores[i]));
+    }
 }
 
 void Engine::initSwapchain()
 {
-    createSwapchain();
+    if (!m_Config.headless) createSwapchain();
 
-    VkExtent3D windowSize = { (uint32_t)m_Window->getSize().x, (uint32_t)m_Window->getSize().y, 1 };
+    VkExtent3D windowSize = { m_Config.extent.width, m_Config.extent.height, 1 };
 
     m_DrawImage.create(m_Device, m_Allocator, windowSize, VK_FORMAT_R16G16B16A16_SFLOAT,
                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
                            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
 
+    // Sampled by light culling, and by the compact and visibility layouts in place of the
+    // position target
     m_DepthImage.create(m_Device, m_Allocator, windowSize, VK_FORMAT_D32_SFLOAT,
-                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    m_DepthImage.createSampler(m_Device, VK_FILTER_NEAREST);
 
+    GBufferLayout layout = m_Config.gBufferLayout;
+    const VkImageUsageFlags gBufferUsage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                                           VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                           VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    if (layout == GBufferLayout::Full)
     {
         m_GBuffer.position.create(m_Device, m_Allocator, windowSize, VK_FORMAT_R16G16B16A16_SFLOAT,
-                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+                                  gBufferUsage);
         m_GBuffer.position.createSampler(m_Device, VK_FILTER_NEAREST);
+    }
 
-        m_GBuffer.normal.create(m_Device, m_Allocator, windowSize, VK_FORMAT_R16G16B16A16_SFLOAT,
-                                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+    if (layout == GBufferLayout::Visibility)
+    {
+        m_GBuffer.visibility.create(m_Device, m_Allocator, windowSize, VK_FORMAT_R32_UINT,
+                                    gBufferUsage);
+        m_GBuffer.visibility.createSampler(m_Device, VK_FILTER_NEAREST);
+    }
+    else
+    {
+        // Two channel float is the smallest format every device can render to, UNORM and SNORM
+        // RG16 attachments are optional
+        VkFormat normalFormat = layout == GBufferLayout::Compact ? VK_FORMAT_R16G16_SFLOAT
+                                                                 : VK_FORMAT_R16G16B16A16_SFLOAT;
+        m_GBuffer.normal.create(m_Device, m_Allocator, windowSize, normalFormat, gBufferUsage);
         m_GBuffer.normal.createSampler(m_Device, VK_FILTER_NEAREST);
 
         m_GBuffer.texData.create(m_Device, m_Allocator, windowSize, VK_FORMAT_R8G8B8A8_SRGB,
-                                 VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+                                 gBufferUsage);
         m_GBuffer.texData.createSampler(m_Device, VK_FILTER_NEAREST);
     }
 
+    // Created even when the pre-pass is off, the lighting pass binds it regardless
+    VkExtent3D maskSize = { (windowSize.width + 1) / 2, (windowSize.height + 1) / 2, 1 };
+    for (AllocatedImage& mask : m_ShadowMask)
     {
-        uint32_t layers = m_MaxLights * 6;
-        m_ShadowMaps.imageFormat = VK_FORMAT_D32_SFLOAT;
-        m_ShadowMaps.imageExtent = { 1600, 1600, 1 };
-
-        VkImageCreateInfo imageCI{};
-        imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageCI.pNext = nullptr;
-        imageCI.flags = 0;
-        imageCI.imageType = VK_IMAGE_TYPE_2D;
-        imageCI.extent = m_ShadowMaps.imageExtent;
-        imageCI.arrayLayers = layers;
-        imageCI.mipLevels = 1;
-        imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageCI.format = m_ShadowMaps.imageFormat;
-        imageCI.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-
-        VmaAllocationCreateInfo allocateCI{};
-        allocateCI.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-        allocateCI.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        VK_CHECK(vmaCreateImage(m_Allocator, &imageCI, &allocateCI, &m_ShadowMaps.image,
-                                &m_ShadowMaps.allocation, nullptr));
-
-        VkImageViewCreateInfo imageViewCI{};
-        imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        imageViewCI.pNext = nullptr;
-        imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-        imageViewCI.image = m_ShadowMaps.image;
-        imageViewCI.format = m_ShadowMaps.imageFormat;
-        imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        imageViewCI.subresourceRange.baseMipLevel = 0;
-        imageViewCI.subresourceRange.levelCount = imageCI.mipLevels;
-        imageViewCI.subresourceRange.baseArrayLayer = 0;
-        imageViewCI.subresourceRange.layerCount = layers;
-
-        VK_CHECK(vkCreateImageView(m_Device, &imageViewCI, nullptr, &m_ShadowMaps.imageView));
-
-        m_ShadowMaps.createSampler(m_Device, VK_FILTER_LINEAR);
+        mask.create(m_Device, m_Allocator, maskSize, VK_FORMAT_R8G8B8A8_UNORM,
+                    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+        mask.createSampler(m_Device, VK_FILTER_NEAREST);
     }
+
+    // A count followed by the fixed size index list, per tile
+    VkExtent2D tileCount = getLightTileCount();
+    m_LightTiles.createBuffer(m_Allocator,
+                              tileCount.width * tileCount.height * (1 + m_MaxLightsPerTile) *
+                                  sizeof(uint32_t),
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    VkFormatProperties shadowFormatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_PhysicalDevice, m_Config.shadowFormat,
+                                        &shadowFormatProperties);
+    bool shadowLinear = m_Config.shadowPcf && (shadowFormatProperties.optimalTilingFeatures &
+                                               VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+    m_ShadowAtlas.create(m_Config.shadowFormat, shadowLinear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST,
+                         m_MinShadowTileSize, m_MaxShadowTileSize);
+
+    // Sized for every shadowed light being a point light at full resolution, so the image and its
+    // descriptor never change while earlier frames may still be sampling them
+    std::vector<uint32_t> worstCase(m_MaxShadowedLights * 6, m_MaxShadowTileSize);
+    std::vector<ShadowTile> worstCaseTiles;
+    m_ShadowAtlas.grow(m_Device, m_Allocator, m_ShadowAtlas.pack(worstCase, worstCaseTiles));
+    m_ShadowScheduler.create(m_Config.shadowFaceBudget, m_Config.shadowBudgetMs);
 }
 
 void Engine::initCommands()
@@ -325,15 +461,37 @@ void Engine::initCommands()
 
         VK_CHECK(
             vkAllocateCommandBuffers(m_Device, &commandBufferAI, &m_Frames[i].mainCommandBuffer));
+
+        // Command pools are externally synchronised, so each recording thread needs its own
+        VkCommandPoolCreateInfo threadPoolCI{};
+        threadPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        threadPoolCI.pNext = nullptr;
+        threadPoolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        threadPoolCI.queueFamilyIndex = m_GraphicsQueueFamily;
+
+        m_Frames[i].threadPools.resize(m_Jobs.getThreadCount());
+        for (ThreadCommandPool& threadPool : m_Frames[i].threadPools)
+        {
+            VK_CHECK(
+                vkCreateCommandPool(m_Device, &threadPoolCI, nullptr, &threadPool.commandPool));
+        }
     }
 }
 
 void Engine::initSyncStructures()
 {
-    VkFenceCreateInfo fenceCI{};
-    fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCI.pNext = nullptr;
-    fenceCI.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VkSemaphoreTypeCreateInfo semaphoreTypeCI{};
+    semaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeCI.pNext = nullptr;
+    semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeCI.initialValue = 0;
+
+    VkSemaphoreCreateInfo timelineCI{};
+    timelineCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timelineCI.pNext = &semaphoreTypeCI;
+
+    VK_CHECK(vkCreateSemaphore(m_Device, &timelineCI, nullptr, &m_FrameTimeline));
+    m_FrameTimelineValue = 0;
 
     VkSemaphoreCreateInfo semaphoreCI{};
     semaphoreCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -341,11 +499,9 @@ void Engine::initSyncStructures()
 
     for (size_t i = 0; i < m_Frames.size(); i++)
     {
-        VK_CHECK(vkCreateFence(m_Device, &fenceCI, nullptr, &m_Frames[i].renderFence));
-
         VK_CHECK(
             vkCreateSemaphore(m_Device, &semaphoreCI, nullptr, &m_Frames[i].swapchainSemaphore));
-        VK_CHECK(vkCreateSemaphore(m_Device, &semaphoreCI, nullptr, &m_Frames[i].renderSemaphore));
+        m_Frames[i].timelineValue = 0;
     }
 }
 
@@ -353,68 +509,133 @@ void Engine::initDescriptorSetLayouts()
 {
     m_DummySetLayout = DescriptorLayoutBuilder::start(m_Device).build();
 
+    const VkShaderStageFlags gBufferStages =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     m_GBufferDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
-                                    .addCombinedImageSampler(0, VK_SHADER_STAGE_FRAGMENT_BIT)
-                                    .addCombinedImageSampler(1, VK_SHADER_STAGE_FRAGMENT_BIT)
-                                    .addCombinedImageSampler(2, VK_SHADER_STAGE_FRAGMENT_BIT)
+                                    .addCombinedImageSampler(0, gBufferStages)
+                                    .addCombinedImageSampler(1, gBufferStages)
+                                    .addCombinedImageSampler(2, gBufferStages)
+                                    .addCombinedImageSampler(3, gBufferStages)
+                                    .addDynamicStorageBuffer(4, gBufferStages)
+                                    .addCombinedImageSampler(5, gBufferStages)
                                     .build();
 
     m_ObjectDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
-                                   .addStorageBuffer(0, VK_SHADER_STAGE_VERTEX_BIT)
+                                   .addDynamicStorageBuffer(0, VK_SHADER_STAGE_VERTEX_BIT)
                                    .build();
 
-    m_LightDescriptorLayout =
-        DescriptorLayoutBuilder::start(m_Device)
-            .addStorageBuffer(0, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT |
-                                     VK_SHADER_STAGE_FRAGMENT_BIT)
-            .addCombinedImageSampler(1, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .build();
+    const VkShaderStageFlags lightStages =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    m_LightDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
+                                  .addDynamicStorageBuffer(0, lightStages)
+                                  .addCombinedImageSampler(1, lightStages)
+                                  .addDynamicStorageBuffer(2, lightStages)
+                                  .build();
 
+    const VkShaderStageFlags materialStages =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     m_MaterialDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
-                                     .addStorageBuffer(0, VK_SHADER_STAGE_FRAGMENT_BIT)
-                                     .addCombinedImageSampler(1, VK_SHADER_STAGE_FRAGMENT_BIT)
-                                     .addCombinedImageSampler(2, VK_SHADER_STAGE_FRAGMENT_BIT)
+                                     .addDynamicStorageBuffer(0, materialStages)
+                                     .addCombinedImageSampler(1, materialStages)
+                                     .addCombinedImageSampler(2, materialStages)
                                      .build();
+
+    m_ShadowCasterDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
+                                         .addDynamicStorageBuffer(0, VK_SHADER_STAGE_VERTEX_BIT)
+                                         .build();
+
+    const VkShaderStageFlags shadowMaskStages =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    m_ShadowMaskDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
+                                       .addCombinedImageSampler(0, shadowMaskStages)
+                                       .addCombinedImageSampler(1, shadowMaskStages)
+                                       .addCombinedImageSampler(2, shadowMaskStages)
+                                       .build();
+
+    m_LightTileDescriptorLayout =
+        DescriptorLayoutBuilder::start(m_Device)
+            .addStorageBuffer(0, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+            .build();
+
+    m_DrawImageDescriptorLayout = DescriptorLayoutBuilder::start(m_Device)
+                                      .addStorageImage(0, VK_SHADER_STAGE_COMPUTE_BIT)
+                                      .build();
 }
 
 void Engine::initPipelines()
 {
+    PROFILE_FUNCTION();
+
     VkPushConstantRange pushConstant{};
     pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     pushConstant.offset = 0;
     pushConstant.size = sizeof(VertexPushConstant);
 
     VkPushConstantRange shadowPushConstant{};
-    shadowPushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    shadowPushConstant.stageFlags = getShadowPushConstantStages();
     shadowPushConstant.offset = 0;
     shadowPushConstant.size = sizeof(ShadowPushConstant);
 
     {
-        m_ShadowMapPipelineLayout =
-            PipelineLayoutBuilder::build(m_Device, { shadowPushConstant },
-                                         { m_LightDescriptorLayout, m_ObjectDescriptorLayout });
+        m_ShadowMapPipelineLayout = PipelineLayoutBuilder::build(
+            m_Device, { shadowPushConstant },
+            { m_LightDescriptorLayout, m_ObjectDescriptorLayout, m_ShadowCasterDescriptorLayout });
 
-        std::optional<VkShaderModule> vertShaderModule =
-            PipelineBuilder::createShaderModule(m_Device, "res/shaders/shadow.vert.spv");
-        std::optional<VkShaderModule> geoShaderModule =
-            PipelineBuilder::createShaderModule(m_Device, "res/shaders/shadow.geo.spv");
+        std::optional<VkShaderModule> vertShaderModule = PipelineBuilder::createShaderModule(
+            m_Device, m_InstancedShadows ? "res/shaders/shadowInstanced.vert.spv"
+                                         : "res/shaders/shadow.vert.spv");
         std::optional<VkShaderModule> fragShaderModule =
             PipelineBuilder::createShaderModule(m_Device, "res/shaders/shadow.frag.spv");
 
-        m_ShadowMapPipeline = PipelineBuilder::start(m_Device, m_ShadowMapPipelineLayout)
-                                  .setShaders(vertShaderModule.value(), geoShaderModule.value(),
-                                              fragShaderModule.value())
-                                  .inputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+        PipelineBuilder builder = PipelineBuilder::start(m_Device, m_ShadowMapPipelineLayout);
+
+        std::optional<VkShaderModule> geoShaderModule;
+        if (m_GeometryShadows)
+        {
+            geoShaderModule =
+                PipelineBuilder::createShaderModule(m_Device, "res/shaders/shadow.geo.spv");
+            builder.setShaders(vertShaderModule.value(), geoShaderModule.value(),
+                               fragShaderModule.value());
+        }
+        else
+            builder.setShaders(vertShaderModule.value(), fragShaderModule.value());
+
+        m_ShadowMapPipeline = builder.inputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
                                   .rasterizer(VK_POLYGON_MODE_FILL, VK_CULL_MODE_FRONT_BIT,
                                               VK_FRONT_FACE_COUNTER_CLOCKWISE)
                                   .setMultisampleNone()
+                                  .setViewportCount(m_GeometryShadows ? m_ShadowViewportCount : 1)
                                   .disableBlending()
-                                  .setDepthFormat(m_ShadowMaps.imageFormat)
+                                  .setDepthFormat(m_ShadowAtlas.getFormat())
                                   .enableDepthTest(VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL)
                                   .build();
 
         vkDestroyShaderModule(m_Device, vertShaderModule.value(), nullptr);
-        vkDestroyShaderModule(m_Device, geoShaderModule.value(), nullptr);
+        vkDestroyShaderModule(m_Device, fragShaderModule.value(), nullptr);
+        if (geoShaderModule) vkDestroyShaderModule(m_Device, geoShaderModule.value(), nullptr);
+    }
+
+    {
+        m_DepthPrepassPipelineLayout = PipelineLayoutBuilder::build(
+            m_Device, { pushConstant }, { m_DummySetLayout, m_ObjectDescriptorLayout });
+
+        std::optional<VkShaderModule> vertShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/depth.vert.spv");
+        std::optional<VkShaderModule> fragShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/depth.frag.spv");
+
+        m_DepthPrepassPipeline = PipelineBuilder::start(m_Device, m_DepthPrepassPipelineLayout)
+                                     .setShaders(vertShaderModule.value(), fragShaderModule.value())
+                                     .inputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+                                     .rasterizer(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT,
+                                                 VK_FRONT_FACE_COUNTER_CLOCKWISE)
+                                     .setMultisampleNone()
+                                     .disableBlending()
+                                     .setDepthFormat(m_DepthImage.imageFormat)
+                                     .enableDepthTest(VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL)
+                                     .build();
+
+        vkDestroyShaderModule(m_Device, vertShaderModule.value(), nullptr);
         vkDestroyShaderModule(m_Device, fragShaderModule.value(), nullptr);
     }
 
@@ -423,10 +644,24 @@ void Engine::initPipelines()
             m_Device, { pushConstant },
             { m_DummySetLayout, m_ObjectDescriptorLayout, m_MaterialDescriptorLayout });
 
+        const char* vertShader = "res/shaders/deferred.vert.spv";
+        const char* fragShader = "res/shaders/deferred.frag.spv";
+        if (m_Config.gBufferLayout == GBufferLayout::Compact)
+            fragShader = "res/shaders/deferredCompact.frag.spv";
+        else if (m_Config.gBufferLayout == GBufferLayout::Visibility)
+        {
+            vertShader = "res/shaders/visibility.vert.spv";
+            fragShader = "res/shaders/visibility.frag.spv";
+        }
+
         std::optional<VkShaderModule> vertShaderModule =
-            PipelineBuilder::createShaderModule(m_Device, "res/shaders/deferred.vert.spv");
+            PipelineBuilder::createShaderModule(m_Device, vertShader);
         std::optional<VkShaderModule> fragShaderModule =
-            PipelineBuilder::createShaderModule(m_Device, "res/shaders/deferred.frag.spv");
+            PipelineBuilder::createShaderModule(m_Device, fragShader);
+
+        std::vector<VkFormat> gBufferFormats;
+        for (AllocatedImage* target : getGBufferTargets())
+            gBufferFormats.push_back(target->imageFormat);
 
         m_DeferredRenderPipeline =
             PipelineBuilder::start(m_Device, m_DeferredRenderPipelineLayout)
@@ -436,9 +671,7 @@ void Engine::initPipelines()
                             VK_FRONT_FACE_COUNTER_CLOCKWISE)
                 .setMultisampleNone()
                 .disableBlending()
-                .addColourAttachmentFormats({ m_GBuffer.position.imageFormat,
-                                              m_GBuffer.normal.imageFormat,
-                                              m_GBuffer.texData.imageFormat })
+                .addColourAttachmentFormats(gBufferFormats)
                 .setDepthFormat(m_DepthImage.imageFormat)
                 .enableDepthTest(VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL)
                 .build();
@@ -447,10 +680,83 @@ void Engine::initPipelines()
         vkDestroyShaderModule(m_Device, fragShaderModule.value(), nullptr);
     }
 
+    // Fullscreen passes over the G-buffer need the camera matrices and mesh buffers to rebuild
+    // what the compact and visibility layouts leave out
+    VkPushConstantRange gBufferPushConstant = pushConstant;
+    gBufferPushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    {
+        m_ShadowMaskPipelineLayout =
+            PipelineLayoutBuilder::build(m_Device, { gBufferPushConstant },
+                                         { m_LightDescriptorLayout, m_GBufferDescriptorLayout });
+
+        std::optional<VkShaderModule> vertShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/mesh.vert.spv");
+        std::optional<VkShaderModule> fragShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/shadowMask.frag.spv");
+
+        m_ShadowMaskPipeline = PipelineBuilder::start(m_Device, m_ShadowMaskPipelineLayout)
+                                   .setShaders(vertShaderModule.value(), fragShaderModule.value())
+                                   .inputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+                                   .rasterizer(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE,
+                                               VK_FRONT_FACE_COUNTER_CLOCKWISE)
+                                   .setMultisampleNone()
+                                   .disableBlending()
+                                   .addColourAttachmentFormats({ m_ShadowMask[0].imageFormat,
+                                                                 m_ShadowMask[1].imageFormat,
+                                                                 m_ShadowMask[2].imageFormat })
+                                   .disableDepthTest()
+                                   .build();
+
+        vkDestroyShaderModule(m_Device, vertShaderModule.value(), nullptr);
+        vkDestroyShaderModule(m_Device, fragShaderModule.value(), nullptr);
+    }
+
+    {
+        VkPushConstantRange cullingPushConstant = pushConstant;
+        cullingPushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        m_LightCullingPipelineLayout = PipelineLayoutBuilder::build(
+            m_Device, { cullingPushConstant },
+            { m_LightDescriptorLayout, m_GBufferDescriptorLayout, m_LightTileDescriptorLayout });
+
+        std::optional<VkShaderModule> compShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/lightCulling.comp.spv");
+
+        m_LightCullingPipeline =
+            ComputePipelineBuilder::start(m_Device, m_LightCullingPipelineLayout)
+                .setShader(compShaderModule.value())
+                .build();
+
+        vkDestroyShaderModule(m_Device, compShaderModule.value(), nullptr);
+    }
+
+    {
+        VkPushConstantRange lightingPushConstant = pushConstant;
+        lightingPushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        m_LightingComputePipelineLayout = PipelineLayoutBuilder::build(
+            m_Device, { lightingPushConstant },
+            { m_LightDescriptorLayout, m_GBufferDescriptorLayout, m_MaterialDescriptorLayout,
+              m_ShadowMaskDescriptorLayout, m_LightTileDescriptorLayout,
+              m_DrawImageDescriptorLayout });
+
+        std::optional<VkShaderModule> compShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/lighting.comp.spv");
+
+        m_LightingComputePipeline =
+            ComputePipelineBuilder::start(m_Device, m_LightingComputePipelineLayout)
+                .setShader(compShaderModule.value())
+                .build();
+
+        vkDestroyShaderModule(m_Device, compShaderModule.value(), nullptr);
+    }
+
     {
         m_SceneRenderPipelineLayout = PipelineLayoutBuilder::build(
-            m_Device, { pushConstant },
-            { m_LightDescriptorLayout, m_GBufferDescriptorLayout, m_MaterialDescriptorLayout });
+            m_Device, { gBufferPushConstant },
+            { m_LightDescriptorLayout, m_GBufferDescriptorLayout, m_MaterialDescriptorLayout,
+              m_ShadowMaskDescriptorLayout, m_LightTileDescriptorLayout });
 
         std::optional<VkShaderModule> vertShaderModule =
             PipelineBuilder::createShaderModule(m_Device, "res/shaders/mesh.vert.spv");
@@ -473,6 +779,34 @@ void Engine::initPipelines()
         vkDestroyShaderModule(m_Device, fragShaderModule.value(), nullptr);
     }
 
+    {
+        m_ForwardPipelineLayout = PipelineLayoutBuilder::build(
+            m_Device, { gBufferPushConstant },
+            { m_LightDescriptorLayout, m_ObjectDescriptorLayout, m_MaterialDescriptorLayout,
+              m_LightTileDescriptorLayout });
+
+        std::optional<VkShaderModule> vertShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/deferred.vert.spv");
+        std::optional<VkShaderModule> fragShaderModule =
+            PipelineBuilder::createShaderModule(m_Device, "res/shaders/forward.frag.spv");
+
+        m_ForwardPipeline = PipelineBuilder::start(m_Device, m_ForwardPipelineLayout)
+                                .setShaders(vertShaderModule.value(), fragShaderModule.value())
+                                .inputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+                                .rasterizer(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT,
+                                            VK_FRONT_FACE_COUNTER_CLOCKWISE)
+                                .setMultisampleNone()
+                                .disableBlending()
+                                .addColourAttachmentFormat(m_DrawImage.imageFormat)
+                                .setDepthFormat(m_DepthImage.imageFormat)
+                                // Only the surface the prepass kept is shaded, each pixel once
+                                .enableDepthTest(VK_FALSE, VK_COMPARE_OP_EQUAL)
+                                .build();
+
+        vkDestroyShaderModule(m_Device, vertShaderModule.value(), nullptr);
+        vkDestroyShaderModule(m_Device, fragShaderModule.value(), nullptr);
+    }
+
     {
         m_LightDrawPipelineLayout =
             PipelineLayoutBuilder::build(m_Device, { pushConstant }, { m_LightDescriptorLayout });
@@ -491,7 +825,9 @@ void Engine::initPipelines()
                                   .disableBlending()
                                   .addColourAttachmentFormat(m_DrawImage.imageFormat)
                                   .setDepthFormat(m_DepthImage.imageFormat)
-                                  .enableDepthTest(VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL)
+                                  // Depth is read only once the G-buffer is done, the compact
+                                  // and visibility layouts sample it for positions
+                                  .enableDepthTest(VK_FALSE, VK_COMPARE_OP_GREATER_OR_EQUAL)
                                   .build();
 
         vkDestroyShaderModule(m_Device, vertShaderModule.value(), nullptr);
@@ -499,20 +835,22 @@ void Engine::initPipelines()
     }
 }
 
-void Engine::initTextures()
+void Engine::initTextures(UploadBatch& uploads)
 {
-    m_BoxTexture.load(m_Device, m_Allocator, "res/textures/container.jpg",
+    PROFILE_FUNCTION();
+
+    m_BoxTexture.load(m_Device, m_Allocator, uploads, "res/textures/container.jpg",
                       VK_IMAGE_USAGE_SAMPLED_BIT);
     m_BoxTexture.createSampler(m_Device, VK_FILTER_LINEAR);
 
-    m_FaceTexture.load(m_Device, m_Allocator, "res/textures/awesomeface.png",
+    m_FaceTexture.load(m_Device, m_Allocator, uploads, "res/textures/awesomeface.png",
                        VK_IMAGE_USAGE_SAMPLED_BIT);
     m_FaceTexture.createSampler(m_Device, VK_FILTER_LINEAR);
 }
 
 void Engine::createMaterials()
 {
-    std::vector<MaterialData> materials = {
+    m_Materials = {
         MaterialData{
                      .ambient = glm::vec3(0.3f),
                      .diffuse = glm::vec3(0.8f),
@@ -523,18 +861,6 @@ void Engine::createMaterials()
                      .diffuse = glm::vec3(1.0f),
                      .specular = glm::vec4(1.0f, 1.0f, 1.0f, 64.0f) }
     };
-
-    size_t size = m_MaxMaterials * sizeof(MaterialData);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        m_MaterialDataBuffer[i].createBuffer(m_Allocator, size,
-                                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                             VMA_MEMORY_USAGE_GPU_ONLY);
-
-        m_MaterialDataBuffer[i].pushData<MaterialData>(m_Allocator, materials);
-    }
 }
 
 void Engine::createObjects()
@@ -549,69 +875,74 @@ void Engine::createObjects()
 
     m_ObjectCount = cubePositions.size();
 
-    size_t size = m_ObjectCount * sizeof(ObjectData);
-
-    std::vector<ObjectData> models(m_ObjectCount);
-    for (size_t i = 0; i < models.size(); i++)
+    m_ObjectTransforms.resize(m_ObjectCount);
+    m_Objects.resize(m_ObjectCount);
+    for (size_t i = 0; i < m_ObjectCount; i++)
     {
-        glm::mat4 model{ 1.0f };
-        model = glm::translate(model, cubePositions[i]);
-        float angle = 20.0f * i;
-        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, -0.3f, 0.5f));
-
-        glm::mat4 rotation =
-            glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(1.0f, -0.3f, 0.5f));
-
-        models.at(i) = { .materialIndex = 0,
-                         .colour = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-                         .model = model,
-                         .rotation = rotation };
+        m_ObjectTransforms[i] = { .position = cubePositions[i],
+                                  .rotationAxis = glm::vec3(1.0f, -0.3f, 0.5f),
+                                  .angle = 20.0f * i };
+        m_Objects[i] = { .materialIndex = 0, .colour = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f) };
     }
 
-    {
-        glm::mat4 model{ 1.0f };
-        model = glm::translate(model, glm::vec3(0.0f, 5.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(15.0f, 1.0f, 15.0f));
-        models.push_back({ .materialIndex = 1,
-                           .colour = glm::vec4(0.2f, 0.2f, 0.2f, 1.0f),
-                           .model = model,
-                           .rotation = glm::mat4(1.0f) });
-        m_ObjectCount++;
-        size += sizeof(ObjectData);
-    }
+    m_ObjectTransforms.push_back({ .position = glm::vec3(0.0f, 5.0f, 0.0f),
+                                   .scale = glm::vec3(15.0f, 1.0f, 15.0f) });
+    m_Objects.push_back({ .materialIndex = 1, .colour = glm::vec4(0.2f, 0.2f, 0.2f, 1.0f) });
+    m_ObjectCount++;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        m_ObjectDataBuffer[i].createBuffer(m_Allocator, size,
-                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                           VMA_MEMORY_USAGE_GPU_ONLY);
+    m_ObjectBounds.resize(m_ObjectCount);
 
-        m_ObjectDataBuffer[i].pushData<ObjectData>(m_Allocator, models);
-    }
+    m_Jobs.wait(updateObjects());
+}
+
+JobHandle Engine::updateObjects()
+{
+    return m_Jobs.parallelFor(m_ObjectCount, m_ObjectsPerJob,
+                              [this](size_t begin, size_t end, size_t) {
+                                  PROFILE_ZONE("updateObjects");
+                                  for (size_t i = begin; i < end; i++)
+                                  {
+                                      updateObjectMatrices(m_Objects[i], m_ObjectTransforms[i]);
+                                      m_ObjectBounds[i] = getObjectBounds(m_ObjectTransforms[i]);
+                                  }
+                              });
 }
 
 void Engine::createLights()
 {
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    // Fixed seed, so every run and every configuration the benchmark compares sees the same lights
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    m_FillLights.clear();
+    for (uint32_t i = 0; i < m_Config.fillLights; i++)
     {
-        m_LightDataBuffer[i].createBuffer(
-            m_Allocator, sizeof(LightData) * m_MaxLights + sizeof(LightGeneralData),
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_GPU_ONLY);
+        glm::vec3 position(16.0f * unit(random) - 8.0f, 12.0f * unit(random) - 6.0f,
+                           -22.0f * unit(random) + 4.0f);
+        glm::vec3 colour(unit(random), unit(random), unit(random));
+
+        LightData light{ .position = position,
+                         .diffuse = 0.5f * colour,
+                         .shadowIndex = NO_SHADOW,
+                         .specular = 0.3f * colour,
+                         .attenuation{ 1.0f, 2.0f, 16.0f } };
+        light.radius = getLightRadius(light, m_Config.lightCutoff, m_MaxLightRadius);
+        m_FillLights.push_back(light);
     }
 
-    uploadLightData();
+    updateLights();
 }
 
-void Engine::uploadLightData()
+void Engine::updateLights()
 {
+    PROFILE_FUNCTION();
+
     float time = 0.001f * m_LightTime;
     glm::vec3 movingLightPosition = glm::vec3(7 * sin(time), 0.0f, 7 * cos(time));
     glm::vec3 movingLightColour =
         glm::vec3(fabs(cos(time) + sin(time)), fabs(cos(time)), fabs(sin(time)));
 
-    std::vector<LightData> lights = {
+    m_SceneLights.assign({
         { .position = glm::vec3(0.1f, -4.0f, 0.0f),
          .diffuse = glm::vec3(0.9f, 0.3f, 0.3f),
          .specular = glm::vec3(0.5f),
@@ -623,7 +954,11 @@ void Engine::uploadLightData()
         { .position{ 0.5f, 3.0f, 5.0f },
          .diffuse{ 0.0f, 0.9f, 0.9f },
          .specular{ 0.5f },
-         .attenuation{ 1.0f, 0.0f, 0.0f } },
+         .type = LightType::Spot,
+         .attenuation{ 1.0f, 0.0f, 0.0f },
+         .spotInnerCos = glm::cos(glm::radians(20.0f)),
+         .direction = glm::normalize(glm::vec3(-0.5f, -3.0f, -5.0f)),
+         .spotOuterCos = glm::cos(glm::radians(30.0f)) },
         { .position{ 3.5f, 3.0f, 5.0f },
          .diffuse{ 0.9f, 0.4f, 0.3f },
          .specular{ 0.5f },
@@ -632,81 +967,345 @@ void Engine::uploadLightData()
          .diffuse{ movingLightColour * 0.6f },
          .specular{ 0.8f },
          .attenuation{ 0.8f, 0.2f, 0.0f } },
-    };
+        { .position{ 0.0f, 0.0f, 0.0f },
+         .radius = 20.0f,
+         .diffuse{ 0.2f, 0.2f, 0.25f },
+         .specular{ 0.1f },
+         .type = LightType::Directional,
+         .attenuation{ 1.0f, 0.0f, 0.0f },
+         .direction = glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f)) },
+    });
+    for (LightData& light : m_SceneLights)
+    {
+        if (light.type != LightType::Directional)
+            light.radius = getLightRadius(light, m_Config.lightCutoff, m_MaxLightRadius);
+    }
+
+    size_t fillLights = std::min(m_FillLights.size(), m_MaxLights - m_SceneLights.size());
+    m_SceneLightCount = m_SceneLights.size() + fillLights;
+
+    // A light whose sphere misses the frustum cannot reach anything on screen, so it is dropped
+    // before any of its shadow faces are placed or drawn
+    glm::mat4 viewProj =
+        m_Camera.getPerspective({ (int)m_Config.extent.width, (int)m_Config.extent.height }) *
+        m_Camera.getView();
+    Frustum frustum = getFrustum(viewProj);
+
+    std::vector<LightData>& lights = m_Lights;
+    lights.clear();
+    m_LightSceneIndices.clear();
+    for (uint32_t i = 0; i < m_SceneLightCount; i++)
+    {
+        const LightData& light = i < m_SceneLights.size()
+                                     ? m_SceneLights[i]
+                                     : m_FillLights[i - m_SceneLights.size()];
+        if (light.type != LightType::Directional &&
+            !sphereInFrustum(frustum, glm::vec4(light.position, light.radius)))
+            continue;
+
+        lights.push_back(light);
+        m_LightSceneIndices.push_back(i);
+    }
     m_LightCount = lights.size();
 
-    LightGeneralData generalData;
-    generalData.lightCount = lights.size();
-    generalData.ambient = glm::vec4(1.0f, 1.0f, 1.0f, 0.1f);
-
-    for (size_t i = 0; i < lights.size(); i++)
-    {
-        glm::mat4 model{ 1.0f };
-        model = glm::translate(model, lights[i].position);
-        model = glm::scale(model, glm::vec3(0.2f));
-        lights[i].model = model;
-
-        glm::mat4 view{ 1.0f };
-        view = glm::lookAt(lights[i].position, glm::vec3(0.0f, 0.0f, 0.0f),
-                           glm::vec3(0.0f, -1.0f, 0.0f));
-
-        float aspect =
-            (float)m_ShadowMaps.imageExtent.width / (float)m_ShadowMaps.imageExtent.height;
-        const float near = 0.1f;
-        const float far = 40.0f;
-
-        glm::mat4 proj{ 1.0f };
-        proj = glm::perspective(glm::radians(90.0f), aspect, far, near);
-        proj[1][1] *= -1;
-
-        lights[i].proj = proj;
-        const std::pair<glm::vec3, glm::vec3> viewDir[6] = {
-            {{ 1.0f, 0.0f, 0.0f },   { 0.0f, -1.0f, 0.0f }},
-            { { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }},
-            { { 0.0f, 1.0f, 0.0f },  { 0.0f, 0.0f, -1.0f }},
-            { { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
-            { { 0.0f, 0.0f, 1.0f },  { 0.0f, -1.0f, 0.0f }},
-            { { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }},
-        };
+    m_LightGeneralData.lightCount = lights.size();
+    // The mask is built from the G-buffer, which the forward path never writes
+    bool shadowMask = m_Config.shadowMask && m_Config.renderPath == RenderPath::Deferred;
+    m_LightGeneralData.shadowMaskLights =
+        shadowMask ? static_cast<int>(std::min(lights.size(), m_ShadowMaskImageCount * 4)) : 0;
+    m_LightGeneralData.gBufferLayout = m_Config.gBufferLayout;
+    m_LightGeneralData.lightTilesPerRow = static_cast<int>(getLightTileCount().width);
+    m_LightGeneralData.ambient = glm::vec4(1.0f, 1.0f, 1.0f, 0.1f);
+
+    // Each light's faces follow on from the previous light's in the shadow face table. Once the
+    // table holds m_MaxShadowedLights lights, the rest lose their shadows for the frame
+    m_ShadowFaceOwners.clear();
+    size_t shadowedLights = 0;
+    for (uint32_t light = 0; light < lights.size(); light++)
+    {
+        if (lights[light].shadowIndex == NO_SHADOW) continue;
+        if (shadowedLights == m_MaxShadowedLights)
+        {
+            lights[light].shadowIndex = NO_SHADOW;
+            continue;
+        }
+        shadowedLights++;
+
+        lights[light].shadowIndex = static_cast<uint32_t>(m_ShadowFaceOwners.size());
+        for (uint32_t face = 0; face < getShadowFaceCount(lights[light]); face++)
+            m_ShadowFaceOwners.push_back({ .light = light, .face = face });
+    }
+
+    m_ShadowFaceData.resize(m_ShadowFaceOwners.size());
+    std::span<ShadowFaceData> shadowFaces = m_ShadowFaceData;
+
+    JobHandle matrices = m_Jobs.parallelFor(
+        lights.size(), m_LightsPerJob, [&lights, shadowFaces](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++)
+            {
+                if (lights[i].shadowIndex == NO_SHADOW) continue;
+                updateShadowFaceMatrices(lights[i],
+                                         shadowFaces.subspan(lights[i].shadowIndex,
+                                                             getShadowFaceCount(lights[i])));
+            }
+        });
+    m_Jobs.wait(matrices);
+
+    updateShadowAtlas();
+}
+
+void Engine::updateShadowAtlas()
+{
+    PROFILE_FUNCTION();
+
+    // Full resolution up close, halving each time the distance to the camera doubles.
+    // Directional lights have no position to be far from and always get the largest tile
+    glm::vec3 cameraPosition = m_Camera.getPosition();
+    m_ShadowTileSizes.clear();
+    for (const LightData& light : m_Lights)
+    {
+        float distance = glm::length(light.position - cameraPosition) / m_ShadowFullResDistance;
+        int level = static_cast<int>(std::floor(std::log2(std::max(distance, 1.0f))));
+        if (light.type == LightType::Directional) level = 0;
+
+        uint32_t size = m_MaxShadowTileSize >> std::min(level, 31);
+        m_ShadowTileSizes.insert(m_ShadowTileSizes.end(), getShadowFaceCount(light), size);
+    }
+
+    m_ShadowAtlasUsed = m_ShadowAtlas.pack(m_ShadowTileSizes, m_ShadowTiles);
+    if (!m_ShadowAtlas.fits(m_ShadowAtlasUsed))
+        throw std::runtime_error("Shadow tiles do not fit in the shadow atlas");
+
+    VkExtent2D extent = m_ShadowAtlas.getExtent();
+    glm::vec2 atlasSize(extent.width, extent.height);
+    for (size_t i = 0; i < m_ShadowFaceData.size(); i++)
+    {
+        const ShadowTile& tile = m_ShadowTiles[i];
+        m_ShadowFaceData[i].rect =
+            glm::vec4(glm::vec2(tile.x, tile.y) / atlasSize, glm::vec2(tile.size) / atlasSize);
+    }
+}
+
+void Engine::updateShadowCache()
+{
+    PROFILE_FUNCTION();
 
-        for (int j = 0; j < 6; j++)
+    // A moved caster dirties the faces it left as well as the ones it entered
+    m_ChangedCasterBounds.clear();
+    if (m_ShadowCasterTransforms.size() != m_ObjectTransforms.size())
+    {
+        m_ShadowCasterTransforms = m_ObjectTransforms;
+        m_ShadowFaces.clear();
+    }
+    else
+    {
+        for (size_t i = 0; i < m_ObjectTransforms.size(); i++)
         {
-            lights[i].view[j] = glm::lookAt(
-                lights[i].position, lights[i].position + viewDir[j].first, viewDir[j].second);
+            if (m_ShadowCasterTransforms[i] == m_ObjectTransforms[i]) continue;
+
+            m_ChangedCasterBounds.push_back(getObjectBounds(m_ShadowCasterTransforms[i]));
+            m_ChangedCasterBounds.push_back(getObjectBounds(m_ObjectTransforms[i]));
+            m_ShadowCasterTransforms[i] = m_ObjectTransforms[i];
         }
     }
 
-    m_CameraView = lights[0].view[2];
-    m_CameraProjection = lights[0].proj;
+    // How far each light moved since the last frame feeds into its faces' importance
+    m_PreviousLightPositions.resize(m_SceneLightCount);
+    if (m_ShadowFaces.size() != m_ShadowFaceData.size())
+    {
+        for (size_t light = 0; light < m_LightCount; light++)
+            m_PreviousLightPositions[m_LightSceneIndices[light]] = m_Lights[light].position;
+    }
+
+    m_ShadowFaces.resize(m_ShadowFaceData.size());
+
+    m_ShadowRequests.clear();
+    for (uint32_t index = 0; index < m_ShadowFaces.size(); index++)
+    {
+        ShadowFaceState& state = m_ShadowFaces[index];
+        const ShadowFaceOwner& owner = m_ShadowFaceOwners[index];
+        const LightData& light = m_Lights[owner.light];
+        const ShadowTile& tile = m_ShadowTiles[index];
+
+        // Stale faces keep showing their last contents until the scheduler gets to them. Culling
+        // shifts the table, so a face now belonging to another light has nothing worth showing
+        uint32_t sceneLight = m_LightSceneIndices[owner.light];
+        bool required = !state.valid || state.tile != tile || state.light != sceneLight;
+        state.stale = state.stale || state.viewProj != m_ShadowFaceData[index].viewProj;
+        for (size_t i = 0; i < m_ChangedCasterBounds.size() && !state.stale; i++)
+            state.stale = sphereInShadowFace(light, owner.face, m_ChangedCasterBounds[i]);
+
+        if (!required && !state.stale) continue;
+
+        // Tile size stands in for screen coverage, as it already falls off with camera distance
+        float coverage = static_cast<float>(tile.size) / m_MaxShadowTileSize;
+        float movement = glm::length(light.position - m_PreviousLightPositions[sceneLight]);
+        m_ShadowRequests.push_back({ .face = index,
+                                     .required = required,
+                                     .importance = coverage * coverage * (1.0f + movement) });
+    }
+
+    for (size_t light = 0; light < m_LightCount; light++)
+        m_PreviousLightPositions[m_LightSceneIndices[light]] = m_Lights[light].position;
+
+    // The profiler resolves frames late, the scheduler matches them up by frame number
+    for (const GpuScopeEvent& event : m_GpuProfiler.getLastFrameEvents())
+    {
+        if (m_GpuProfiler.getStats()[event.scope].name != "shadow") continue;
+        m_ShadowScheduler.reportGpuTime(event.frame, (event.endNs - event.beginNs) * 1e-6);
+    }
+
+    m_DirtyShadowFaces =
+        m_ShadowScheduler.schedule(m_CurrentFrame, m_ShadowRequests).refreshedFaces;
+    for (uint32_t index : m_DirtyShadowFaces)
+    {
+        m_ShadowFaces[index] = {
+            .tile = m_ShadowTiles[index],
+            .viewProj = m_ShadowFaceData[index].viewProj,
+            .light = m_LightSceneIndices[m_ShadowFaceOwners[index].light],
+            .valid = true,
+            .stale = false,
+        };
+    }
+
+    // A face left stale still holds depth rendered with its old matrix, so it has to be looked up
+    // with that one until it is redrawn. Required faces are always refreshed, so these are valid
+    for (uint32_t index = 0; index < m_ShadowFaces.size(); index++)
+    {
+        if (m_ShadowFaces[index].stale)
+            m_ShadowFaceData[index].viewProj = m_ShadowFaces[index].viewProj;
+    }
+}
+
+void Engine::cullShadowCasters()
+{
+    PROFILE_FUNCTION();
+
+    // Faces are counted first, then each face scatters its casters straight into its own run of
+    // m_ShadowCasters, so every face's casters are one contiguous run of instances
+    m_ShadowDraws.resize(m_DirtyShadowFaces.size());
+    JobHandle counting = m_Jobs.parallelFor(
+        m_DirtyShadowFaces.size(), 1, [this](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t face = m_DirtyShadowFaces[i];
+                const ShadowFaceOwner& owner = m_ShadowFaceOwners[face];
+                const LightData& light = m_Lights[owner.light];
+
+                uint32_t count = 0;
+                for (uint32_t object = 0; object < m_ObjectCount; object++)
+                    count += sphereInShadowFace(light, owner.face, m_ObjectBounds[object]);
+
+                m_ShadowDraws[i] = { .face = face, .firstCaster = 0, .casterCount = count };
+            }
+        });
+    m_Jobs.wait(counting);
+
+    uint32_t casterCount = 0;
+    for (ShadowFaceDraw& draw : m_ShadowDraws)
+    {
+        draw.firstCaster = casterCount;
+        casterCount += draw.casterCount;
+    }
+    m_ShadowCasters.resize(casterCount);
+
+    JobHandle scatter = m_Jobs.parallelFor(
+        m_ShadowDraws.size(), 1, [this](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++)
+            {
+                const ShadowFaceDraw& draw = m_ShadowDraws[i];
+                const ShadowFaceOwner& owner = m_ShadowFaceOwners[draw.face];
+                const LightData& light = m_Lights[owner.light];
+
+                uint32_t caster = draw.firstCaster;
+                for (uint32_t object = 0; object < m_ObjectCount; object++)
+                {
+                    if (sphereInShadowFace(light, owner.face, m_ObjectBounds[object]))
+                        m_ShadowCasters[caster++] = { .object = object, .face = draw.face };
+                }
+            }
+        });
+    m_Jobs.wait(scatter);
+}
+
+void Engine::initFrameData()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    const size_t alignment = properties.limits.minStorageBufferOffsetAlignment;
+
+    auto aligned = [alignment](size_t size) { return (size + alignment - 1) & ~(alignment - 1); };
+
+    size_t frameSize = aligned(m_ObjectCount * sizeof(ObjectData)) +
+                       aligned(m_MaxLights * sizeof(LightData) + sizeof(LightGeneralData)) +
+                       aligned(m_MaxShadowedLights * 6 * sizeof(ShadowFaceData)) +
+                       aligned(m_MaxMaterials * sizeof(MaterialData)) +
+                       aligned(getMaxShadowCasters() * sizeof(ShadowCaster));
+
+    m_FrameDataRing.create(m_Allocator, frameSize, m_Frames.size(), alignment,
+                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    // Caster culling resizes these every frame, reserving the worst case keeps it allocation free
+    m_ShadowCasters.reserve(getMaxShadowCasters());
+    m_ShadowDraws.reserve(m_MaxShadowedLights * 6);
+}
+
+void Engine::uploadFrameData()
+{
+    PROFILE_FUNCTION();
+
+    m_FrameDataRing.beginFrame(getCurrentFrameIndex());
+
+    {
+        RingAllocation allocation = m_FrameDataRing.push<ObjectData>(
+            m_Objects, m_ObjectCount * sizeof(ObjectData));
+        m_ObjectDataOffset = allocation.offset;
+    }
+
+    {
+        RingAllocation allocation =
+            m_FrameDataRing.allocate(m_MaxLights * sizeof(LightData) + sizeof(LightGeneralData));
 
-    size_t size = lights.size() * sizeof(LightData) + sizeof(LightGeneralData);
+        memcpy(allocation.data, &m_LightGeneralData, sizeof(LightGeneralData));
+        memcpy((char*)allocation.data + sizeof(LightGeneralData), m_Lights.data(),
+               m_Lights.size() * sizeof(LightData));
 
-    AllocatedBuffer staging;
-    staging.createBuffer(m_Allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                         VMA_MEMORY_USAGE_CPU_TO_GPU);
+        m_LightDataOffset = allocation.offset;
+    }
 
-    memcpy(staging.allocationInfo.pMappedData, &generalData, sizeof(LightGeneralData));
+    {
+        RingAllocation allocation = m_FrameDataRing.push<ShadowFaceData>(
+            m_ShadowFaceData, m_MaxShadowedLights * 6 * sizeof(ShadowFaceData));
+        m_ShadowFaceDataOffset = allocation.offset;
+    }
 
-    memcpy((char*)staging.allocationInfo.pMappedData + sizeof(LightGeneralData), lights.data(),
-           lights.size() * sizeof(LightData));
+    {
+        RingAllocation allocation = m_FrameDataRing.push<MaterialData>(
+            m_Materials, m_MaxMaterials * sizeof(MaterialData));
+        m_MaterialDataOffset = allocation.offset;
+    }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
-        m_LightDataBuffer[i].pushFromBuffer(m_Allocator, staging, size);
+        RingAllocation allocation = m_FrameDataRing.push<ShadowCaster>(
+            m_ShadowCasters, getMaxShadowCasters() * sizeof(ShadowCaster));
+        m_ShadowCasterOffset = allocation.offset;
     }
 
-    staging.destroyBuffer(m_Allocator);
+    m_FrameDataRing.flush(m_Allocator);
 }
 
 void Engine::initDescriptorPool()
 {
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-         .descriptorCount = MAX_FRAMES_IN_FLIGHT * 6                                                   },
-        { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,        .descriptorCount = MAX_FRAMES_IN_FLIGHT * 3},
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  .descriptorCount = 11},
+        { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = 6 },
+        { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         .descriptorCount = 1},
+        { .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          .descriptorCount = 1},
     };
 
-    const uint32_t maxSets = MAX_FRAMES_IN_FLIGHT * 5;
+    // Per-frame data is bound through dynamic offsets into m_FrameDataRing, so every set is
+    // shared by all frames in flight
+    const uint32_t maxSets = 9;
 
     VkDescriptorPoolCreateInfo descriptorPoolCI{};
     descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -719,52 +1318,109 @@ void Engine::initDescriptorPool()
 
 void Engine::initDescriptorSets()
 {
+    PROFILE_FUNCTION();
+
     std::vector<VkDescriptorSet> temp;
     temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, 1, m_DummySetLayout).build();
     m_DummySet = temp[0];
 
-    m_GBufferDescriptor =
-        DescriptorSetBuilder::start(m_Device, m_DescriptorPool, MAX_FRAMES_IN_FLIGHT,
-                                    m_GBufferDescriptorLayout)
-            .addCombinedImageSampler(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                     m_GBuffer.position.imageView,
-                                     m_GBuffer.position.imageSampler.value())
-            .addCombinedImageSampler(1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                     m_GBuffer.normal.imageView,
-                                     m_GBuffer.normal.imageSampler.value())
-            .addCombinedImageSampler(2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                     m_GBuffer.texData.imageView,
-                                     m_GBuffer.texData.imageSampler.value())
-            .build();
-
-    m_ObjectDescriptors =
-        DescriptorSetBuilder::start(m_Device, m_DescriptorPool, MAX_FRAMES_IN_FLIGHT,
-                                    m_ObjectDescriptorLayout)
-            .addStorageBuffers(0, m_ObjectDataBuffer, 0, m_ObjectCount * sizeof(ObjectData))
-            .build();
+    // Every binding is statically used whatever the layout, so the ones a layout has no target
+    // for point at one it does have. gbuffer.glsl never reads them
+    {
+        std::vector<AllocatedImage*> targets = getGBufferTargets();
+        std::array<AllocatedImage*, 4> bindings = { &m_GBuffer.position, &m_GBuffer.normal,
+                                                    &m_GBuffer.texData, targets[0] };
+        if (m_Config.gBufferLayout == GBufferLayout::Compact)
+            bindings = { &m_DepthImage, targets[0], targets[1], targets[0] };
+        else if (m_Config.gBufferLayout == GBufferLayout::Visibility)
+            bindings = { &m_DepthImage, targets[0], targets[0], targets[0] };
+
+        std::array<VkImageLayout, 4> layouts;
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            layouts[i] = bindings[i] == &m_DepthImage ? VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL
+                                                      : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
 
-    m_LightDescriptors =
-        DescriptorSetBuilder::start(m_Device, m_DescriptorPool, MAX_FRAMES_IN_FLIGHT,
-                                    m_LightDescriptorLayout)
-            .addStorageBuffers(0, m_LightDataBuffer, 0,
-                               m_MaxLights * sizeof(LightData) + sizeof(LightGeneralData))
-            .addCombinedImageSampler(1, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
-                                     m_ShadowMaps.imageView, m_ShadowMaps.imageSampler.value())
-            .build();
+        temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_GBufferDescriptorLayout)
+                   .addCombinedImageSampler(0, layouts[0], bindings[0]->imageView,
+                                            bindings[0]->imageSampler.value())
+                   .addCombinedImageSampler(1, layouts[1], bindings[1]->imageView,
+                                            bindings[1]->imageSampler.value())
+                   .addCombinedImageSampler(2, layouts[2], bindings[2]->imageView,
+                                            bindings[2]->imageSampler.value())
+                   .addCombinedImageSampler(3, layouts[3], bindings[3]->imageView,
+                                            bindings[3]->imageSampler.value())
+                   .addDynamicStorageBuffer(4, m_FrameDataRing.buffer.buffer,
+                                            m_ObjectCount * sizeof(ObjectData))
+                   .addCombinedImageSampler(5, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                                            m_DepthImage.imageView,
+                                            m_DepthImage.imageSampler.value())
+                   .build();
+        m_GBufferDescriptor = temp[0];
+    }
 
-    m_MaterialDescriptors =
-        DescriptorSetBuilder::start(m_Device, m_DescriptorPool, MAX_FRAMES_IN_FLIGHT,
-                                    m_MaterialDescriptorLayout)
-            .addStorageBuffers(0, m_MaterialDataBuffer, 0, m_MaxMaterials * sizeof(MaterialData))
-            .addCombinedImageSampler(1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                     m_BoxTexture.imageView, m_BoxTexture.imageSampler.value())
-            .addCombinedImageSampler(2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                     m_FaceTexture.imageView, m_FaceTexture.imageSampler.value())
-            .build();
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_ObjectDescriptorLayout)
+               .addDynamicStorageBuffer(0, m_FrameDataRing.buffer.buffer,
+                                        m_ObjectCount * sizeof(ObjectData))
+               .build();
+    m_ObjectDescriptor = temp[0];
+
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_LightDescriptorLayout)
+               .addDynamicStorageBuffer(0, m_FrameDataRing.buffer.buffer,
+                                        m_MaxLights * sizeof(LightData) + sizeof(LightGeneralData))
+               .addCombinedImageSampler(1, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                                        m_ShadowAtlas.image.imageView,
+                                        m_ShadowAtlas.image.imageSampler.value())
+               .addDynamicStorageBuffer(2, m_FrameDataRing.buffer.buffer,
+                                        m_MaxShadowedLights * 6 * sizeof(ShadowFaceData))
+               .build();
+    m_LightDescriptor = temp[0];
+
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_MaterialDescriptorLayout)
+               .addDynamicStorageBuffer(0, m_FrameDataRing.buffer.buffer,
+                                        m_MaxMaterials * sizeof(MaterialData))
+               .addCombinedImageSampler(1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                        m_BoxTexture.imageView, m_BoxTexture.imageSampler.value())
+               .addCombinedImageSampler(2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                        m_FaceTexture.imageView, m_FaceTexture.imageSampler.value())
+               .build();
+    m_MaterialDescriptor = temp[0];
+
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_ShadowMaskDescriptorLayout)
+               .addCombinedImageSampler(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                        m_ShadowMask[0].imageView,
+                                        m_ShadowMask[0].imageSampler.value())
+               .addCombinedImageSampler(1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                        m_ShadowMask[1].imageView,
+                                        m_ShadowMask[1].imageSampler.value())
+               .addCombinedImageSampler(2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                        m_ShadowMask[2].imageView,
+                                        m_ShadowMask[2].imageSampler.value())
+               .build();
+    m_ShadowMaskDescriptor = temp[0];
+
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_ShadowCasterDescriptorLayout)
+               .addDynamicStorageBuffer(0, m_FrameDataRing.buffer.buffer,
+                                        getMaxShadowCasters() * sizeof(ShadowCaster))
+               .build();
+    m_ShadowCasterDescriptor = temp[0];
+
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_LightTileDescriptorLayout)
+               .addStorageBuffer(0, m_LightTiles.buffer, 0, VK_WHOLE_SIZE)
+               .build();
+    m_LightTileDescriptor = temp[0];
+
+    temp = DescriptorSetBuilder::start(m_Device, m_DescriptorPool, m_DrawImageDescriptorLayout)
+               .addStorageImage(0, VK_IMAGE_LAYOUT_GENERAL, m_DrawImage.imageView)
+               .build();
+    m_DrawImageDescriptor = temp[0];
 }
 
-void Engine::createMesh()
+void Engine::createMesh(UploadBatch& uploads)
 {
+    PROFILE_FUNCTION();
+
     std::vector<Vertex> vertices = {
   // Front: 0-3
         { .position = { -0.5f, -0.5f, 0.5f },
@@ -855,137 +1511,374 @@ void Engine::createMesh()
         16, 17, 18, 17, 19, 18, // Top
         20, 21, 22, 21, 23, 22  // Bottom
     };
-    m_BasicMesh.createMesh<Vertex>(m_Device, m_Allocator, indices, vertices);
+    m_BasicMesh.createMesh<Vertex>(m_Device, m_Allocator, uploads, indices, vertices);
+
+    if (m_Config.gBufferLayout == GBufferLayout::Visibility &&
+        m_BasicMesh.indexCount / 3 > m_MaxVisibilityTriangles)
+    {
+        throw std::runtime_error("Mesh has too many triangles for the visibility buffer");
+    }
 }
 
-FrameData& Engine::getCurrentFrame() { return m_Frames[m_CurrentFrame % MAX_FRAMES_IN_FLIGHT]; }
+size_t Engine::getCurrentFrameIndex() const { return m_CurrentFrame % m_Frames.size(); }
+
+FrameData& Engine::getCurrentFrame() { return m_Frames[getCurrentFrameIndex()]; }
 
-void Engine::renderShadow(VkCommandBuffer& cmd)
+VkCommandBuffer Engine::beginSecondary(size_t thread, std::span<const VkFormat> colourFormats,
+                                       VkFormat depthFormat)
 {
-    VkRenderingAttachmentInfo depthAI{};
-    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    depthAI.pNext = nullptr;
-    depthAI.imageView = m_ShadowMaps.imageView;
-    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthAI.clearValue.depthStencil.depth = 0.0f;
+    ThreadCommandPool& threadPool = getCurrentFrame().threadPools[thread];
 
-    VkRenderingInfo renderInfo{};
-    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    renderInfo.pNext = nullptr;
-    renderInfo.flags = 0;
-    renderInfo.renderArea =
-        VkRect2D({ 0, 0 }, { m_ShadowMaps.imageExtent.width, m_ShadowMaps.imageExtent.height });
-    renderInfo.layerCount = m_MaxLights * 6;
-    renderInfo.colorAttachmentCount = 0;
-    renderInfo.pColorAttachments = nullptr;
-    renderInfo.pDepthAttachment = &depthAI;
-    renderInfo.pStencilAttachment = nullptr;
+    if (threadPool.used == threadPool.commandBuffers.size())
+    {
+        VkCommandBufferAllocateInfo commandBufferAI{};
+        commandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAI.pNext = nullptr;
+        commandBufferAI.commandPool = threadPool.commandPool;
+        commandBufferAI.commandBufferCount = 1;
+        commandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
 
-    vkCmdBeginRendering(cmd, &renderInfo);
+        VkCommandBuffer commandBuffer;
+        VK_CHECK(vkAllocateCommandBuffers(m_Device, &commandBufferAI, &commandBuffer));
+        threadPool.commandBuffers.push_back(commandBuffer);
+    }
+
+    VkCommandBuffer cmd = threadPool.commandBuffers[threadPool.used++];
+
+    VkCommandBufferInheritanceRenderingInfo renderingII{};
+    renderingII.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    renderingII.pNext = nullptr;
+    renderingII.flags = 0;
+    renderingII.viewMask = 0;
+    renderingII.colorAttachmentCount = static_cast<uint32_t>(colourFormats.size());
+    renderingII.pColorAttachmentFormats = colourFormats.data();
+    renderingII.depthAttachmentFormat = depthFormat;
+    renderingII.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    renderingII.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = &renderingII;
+
+    VkCommandBufferBeginInfo commandBufferBI{};
+    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBI.pNext = nullptr;
+    commandBufferBI.pInheritanceInfo = &inheritanceInfo;
+    commandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(cmd, &commandBufferBI));
+
+    return cmd;
+}
+
+RecordedPasses Engine::recordPasses()
+{
+    PROFILE_FUNCTION();
+
+    struct RecordTask {
+        std::span<const VkFormat> colourFormats;
+        VkFormat depthFormat;
+        std::function<void(VkCommandBuffer)> record;
+    };
+
+    std::vector<VkFormat> gBufferFormats;
+    for (AllocatedImage* target : getGBufferTargets())
+        gBufferFormats.push_back(target->imageFormat);
+    const std::array<VkFormat, 1> drawFormats = { m_DrawImage.imageFormat };
+    const std::array<VkFormat, m_ShadowMaskImageCount> shadowMaskFormats = {
+        m_ShadowMask[0].imageFormat, m_ShadowMask[1].imageFormat, m_ShadowMask[2].imageFormat
+    };
+
+    std::vector<RecordTask> tasks;
+
+    // The instanced path draws every dirty face in one task, the geometry shader path as many
+    // faces as it has viewports and the per-face fallback a light per task. Faces are sorted by
+    // light, so each light's faces are a contiguous run
+    std::span<const ShadowFaceDraw> shadowDraws = m_ShadowDraws;
+    auto lightOf = [this](const ShadowFaceDraw& draw) {
+        return m_ShadowFaceOwners[draw.face].light;
+    };
+    auto sameTask = [&](size_t first, size_t last) {
+        if (m_InstancedShadows) return true;
+        if (m_GeometryShadows) return last - first < m_ShadowViewportCount;
+        return lightOf(shadowDraws[last]) == lightOf(shadowDraws[first]);
+    };
+    for (size_t first = 0; first < shadowDraws.size();)
+    {
+        size_t last = first + 1;
+        while (last < shadowDraws.size() && sameTask(first, last))
+            last++;
+
+        std::span<const ShadowFaceDraw> draws = shadowDraws.subspan(first, last - first);
+        tasks.push_back({ .colourFormats = {},
+                          .depthFormat = m_ShadowAtlas.getFormat(),
+                          .record = [this, draws](VkCommandBuffer cmd) {
+                              recordShadow(cmd, draws);
+                          } });
+        first = last;
+    }
+    const size_t shadowTasks = tasks.size();
+
+    // The forward path draws the object ranges twice, once into depth and once lit. The deferred
+    // path's single G-buffer pass stands in for the prepass
+    bool forward = m_Config.renderPath == RenderPath::ForwardPlus;
+
+    size_t rangeCount = std::clamp<size_t>(m_ObjectCount / m_MinObjectsPerRange, 1,
+                                           m_Jobs.getThreadCount());
+    size_t rangeSize = (m_ObjectCount + rangeCount - 1) / rangeCount;
+    for (size_t first = 0; first < m_ObjectCount; first += rangeSize)
+    {
+        uint32_t count = static_cast<uint32_t>(std::min(rangeSize, m_ObjectCount - first));
+        if (forward)
+        {
+            tasks.push_back({ .colourFormats = {},
+                              .depthFormat = m_DepthImage.imageFormat,
+                              .record = [this, first, count](VkCommandBuffer cmd) {
+                                  recordDepthPrepass(cmd, static_cast<uint32_t>(first), count);
+                              } });
+            continue;
+        }
+
+        tasks.push_back({ .colourFormats = gBufferFormats,
+                          .depthFormat = m_DepthImage.imageFormat,
+                          .record = [this, first, count](VkCommandBuffer cmd) {
+                              recordGBuffer(cmd, static_cast<uint32_t>(first), count);
+                          } });
+    }
+    const size_t geometryTasks = tasks.size() - shadowTasks;
+
+    if (m_Config.shadowMask && !forward)
+    {
+        tasks.push_back({ .colourFormats = shadowMaskFormats,
+                          .depthFormat = VK_FORMAT_UNDEFINED,
+                          .record = [this](VkCommandBuffer cmd) { recordShadowMask(cmd); } });
+    }
+    const size_t shadowMaskTasks = tasks.size() - shadowTasks - geometryTasks;
+
+    for (size_t first = 0; forward && first < m_ObjectCount; first += rangeSize)
+    {
+        uint32_t count = static_cast<uint32_t>(std::min(rangeSize, m_ObjectCount - first));
+        tasks.push_back({ .colourFormats = drawFormats,
+                          .depthFormat = m_DepthImage.imageFormat,
+                          .record = [this, first, count](VkCommandBuffer cmd) {
+                              recordForward(cmd, static_cast<uint32_t>(first), count);
+                          } });
+    }
+
+    tasks.push_back({ .colourFormats = drawFormats,
+                      .depthFormat = m_DepthImage.imageFormat,
+                      .record = [this](VkCommandBuffer cmd) { recordLighting(cmd); } });
+
+    std::vector<VkCommandBuffer> commandBuffers(tasks.size());
+    JobHandle recording =
+        m_Jobs.parallelFor(tasks.size(), 1, [&](size_t begin, size_t end, size_t thread) {
+            for (size_t index = begin; index < end; index++)
+            {
+                const RecordTask& task = tasks[index];
+
+                VkCommandBuffer cmd = beginSecondary(thread, task.colourFormats, task.depthFormat);
+                task.record(cmd);
+                VK_CHECK(vkEndCommandBuffer(cmd));
+
+                commandBuffers[index] = cmd;
+            }
+        });
+    m_Jobs.wait(recording);
+
+    RecordedPasses passes;
+    auto shadowEnd = commandBuffers.begin() + shadowTasks;
+    auto geometryEnd = shadowEnd + geometryTasks;
+    auto shadowMaskEnd = geometryEnd + shadowMaskTasks;
+    passes.shadow.assign(commandBuffers.begin(), shadowEnd);
+    (forward ? passes.depthPrepass : passes.gBuffer).assign(shadowEnd, geometryEnd);
+    passes.shadowMask.assign(geometryEnd, shadowMaskEnd);
+    passes.lighting.assign(shadowMaskEnd, commandBuffers.end());
+
+    return passes;
+}
+
+void Engine::recordShadow(VkCommandBuffer cmd, std::span<const ShadowFaceDraw> draws)
+{
+    PROFILE_FUNCTION();
+
+    VkExtent2D atlasExtent = m_ShadowAtlas.getExtent();
 
     VkViewport viewport{};
     viewport.x = 0;
     viewport.y = 0;
-    viewport.width = m_ShadowMaps.imageExtent.width;
-    viewport.height = m_ShadowMaps.imageExtent.height;
+    viewport.width = atlasExtent.width;
+    viewport.height = atlasExtent.height;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
 
     VkRect2D scissor{};
     scissor.offset.x = 0.0f;
     scissor.offset.y = 0.0f;
-    scissor.extent.width = m_ShadowMaps.imageExtent.width;
-    scissor.extent.height = m_ShadowMaps.imageExtent.height;
+    scissor.extent = m_ShadowAtlasUsed;
+
+    // Dynamic offsets go in binding order, light records then shadow faces
+    std::array<uint32_t, 2> lightOffsets = { m_LightDataOffset, m_ShadowFaceDataOffset };
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMapPipeline);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMapPipelineLayout, 0, 1,
-                            &m_LightDescriptors[m_CurrentFrame % 2], 0, nullptr);
+                            &m_LightDescriptor, static_cast<uint32_t>(lightOffsets.size()),
+                            lightOffsets.data());
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMapPipelineLayout, 1, 1,
-                            &m_ObjectDescriptors[m_CurrentFrame % 2], 0, nullptr);
-
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
+                            &m_ObjectDescriptor, 1, &m_ObjectDataOffset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMapPipelineLayout, 2, 1,
+                            &m_ShadowCasterDescriptor, 1, &m_ShadowCasterOffset);
 
     vkCmdBindIndexBuffer(cmd, m_BasicMesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-    for (size_t i = 0; i < m_LightCount; i++)
+    // The pass loads the atlas so cached faces survive, only the redrawn tiles are cleared
+    std::vector<VkClearRect> clearRects;
+    for (const ShadowFaceDraw& draw : draws)
     {
-        ShadowPushConstant shadowPushConstant{};
-        shadowPushConstant.vertexBuffer = m_BasicMesh.vertexBufferAddress;
-        shadowPushConstant.currentLight = {};
-        shadowPushConstant.currentLight.x = (int)i;
+        const ShadowTile& tile = m_ShadowTiles[draw.face];
+        clearRects.push_back({
+            .rect = { { (int32_t)tile.x, (int32_t)tile.y }, { tile.size, tile.size } },
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        });
+    }
+
+    VkClearAttachment clear{};
+    clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    clear.clearValue.depthStencil.depth = 0.0f;
+    vkCmdClearAttachments(cmd, 1, &clear, static_cast<uint32_t>(clearRects.size()),
+                          clearRects.data());
 
-        vkCmdPushConstants(cmd, m_ShadowMapPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                           sizeof(ShadowPushConstant), &shadowPushConstant);
+    ShadowPushConstant shadowPushConstant{};
+    shadowPushConstant.vertexBuffer = m_BasicMesh.vertexBufferAddress;
 
-        vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, m_ObjectCount, 0, 0, 0);
+    // recordPasses() gives this path at most m_ShadowViewportCount faces, one per viewport
+    std::vector<VkViewport> viewports;
+    std::vector<VkRect2D> scissors;
+    if (m_GeometryShadows)
+    {
+        std::fill(std::begin(shadowPushConstant.viewportFaces),
+                  std::end(shadowPushConstant.viewportFaces), UINT32_MAX);
+
+        for (size_t i = 0; i < draws.size(); i++)
+        {
+            const ShadowTile& tile = m_ShadowTiles[draws[i].face];
+            shadowPushConstant.viewportFaces[i] = draws[i].face;
+
+            viewports.push_back({ .x = (float)tile.x,
+                                  .y = (float)tile.y,
+                                  .width = (float)tile.size,
+                                  .height = (float)tile.size,
+                                  .minDepth = 0.0f,
+                                  .maxDepth = 1.0f });
+            scissors.push_back({ { (int32_t)tile.x, (int32_t)tile.y }, { tile.size, tile.size } });
+        }
+
+        // Every viewport the pipeline declares needs setting, the unused ones repeat the first
+        viewports.resize(m_ShadowViewportCount, viewports.front());
+        scissors.resize(m_ShadowViewportCount, scissors.front());
     }
 
-    vkCmdEndRendering(cmd);
+    vkCmdPushConstants(cmd, m_ShadowMapPipelineLayout, getShadowPushConstantStages(), 0,
+                       sizeof(ShadowPushConstant), &shadowPushConstant);
+
+    if (m_InstancedShadows || m_GeometryShadows)
+    {
+        // The vertex shader clips each instance to its own tile, or the geometry shader sends it
+        // to its face's viewport. The draws' casters are one contiguous run, so they all go out
+        // as a single draw
+        if (m_GeometryShadows)
+        {
+            vkCmdSetViewport(cmd, 0, m_ShadowViewportCount, viewports.data());
+            vkCmdSetScissor(cmd, 0, m_ShadowViewportCount, scissors.data());
+        }
+        else
+        {
+            vkCmdSetViewport(cmd, 0, 1, &viewport);
+            vkCmdSetScissor(cmd, 0, 1, &scissor);
+        }
+
+        uint32_t casterCount = 0;
+        for (const ShadowFaceDraw& draw : draws)
+            casterCount += draw.casterCount;
+
+        if (casterCount != 0)
+        {
+            vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, casterCount, 0, 0,
+                             draws.front().firstCaster);
+        }
+        return;
+    }
+
+    for (const ShadowFaceDraw& draw : draws)
+    {
+        // The tile is already cleared, which is all a face without casters needs
+        if (draw.casterCount == 0) continue;
+
+        const ShadowTile& tile = m_ShadowTiles[draw.face];
+
+        viewport.x = tile.x;
+        viewport.y = tile.y;
+        viewport.width = tile.size;
+        viewport.height = tile.size;
+
+        scissor.offset = { (int32_t)tile.x, (int32_t)tile.y };
+        scissor.extent = { tile.size, tile.size };
+
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+        vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, draw.casterCount, 0, 0, draw.firstCaster);
+    }
 }
 
-void Engine::renderDeferred(VkCommandBuffer& cmd)
+void Engine::recordDepthPrepass(VkCommandBuffer cmd, uint32_t firstObject, uint32_t objectCount)
 {
-    VkRenderingAttachmentInfo positionAI{};
-    positionAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    positionAI.pNext = nullptr;
-    positionAI.imageView = m_GBuffer.position.imageView;
-    positionAI.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    positionAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    positionAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    positionAI.clearValue.color = {
-        {0.0f, 0.0f, 0.0f, 0.0f}
-    };
+    PROFILE_FUNCTION();
 
-    VkRenderingAttachmentInfo normalAI{};
-    normalAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    normalAI.pNext = nullptr;
-    normalAI.imageView = m_GBuffer.normal.imageView;
-    normalAI.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    normalAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    normalAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    normalAI.clearValue.color = {
-        {0.0f, 0.0f, 0.0f, 0.0f}
-    };
+    VkViewport viewport{};
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = m_DrawImage.imageExtent.width;
+    viewport.height = m_DrawImage.imageExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
 
-    VkRenderingAttachmentInfo texAI{};
-    texAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    texAI.pNext = nullptr;
-    texAI.imageView = m_GBuffer.texData.imageView;
-    texAI.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    texAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    texAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    texAI.clearValue.color = {
-        {0.0f, 0.0f, 0.0f, 0.0f}
-    };
+    VkRect2D scissor{};
+    scissor.offset.x = 0.0f;
+    scissor.offset.y = 0.0f;
+    scissor.extent.width = m_DrawImage.imageExtent.width;
+    scissor.extent.height = m_DrawImage.imageExtent.height;
 
-    VkRenderingAttachmentInfo depthAI{};
-    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    depthAI.pNext = nullptr;
-    depthAI.imageView = m_DepthImage.imageView;
-    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthAI.clearValue.depthStencil.depth = -1.0f;
+    VertexPushConstant pushConstantData{};
+    pushConstantData.view = m_Camera.getView();
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
+    pushConstantData.cameraPos = m_Camera.getPosition();
+    pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
 
-    const std::vector<VkRenderingAttachmentInfo> colourAttachments = { positionAI, normalAI,
-                                                                       texAI };
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthPrepassPipeline);
 
-    VkRenderingInfo renderInfo{};
-    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    renderInfo.pNext = nullptr;
-    renderInfo.flags = 0;
-    renderInfo.renderArea =
-        VkRect2D({ 0, 0 }, { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height });
-    renderInfo.layerCount = 1;
-    renderInfo.colorAttachmentCount = static_cast<uint32_t>(colourAttachments.size());
-    renderInfo.pColorAttachments = colourAttachments.data();
-    renderInfo.pDepthAttachment = &depthAI;
-    renderInfo.pStencilAttachment = nullptr;
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthPrepassPipelineLayout, 0,
+                            1, &m_DummySet, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DepthPrepassPipelineLayout, 1,
+                            1, &m_ObjectDescriptor, 1, &m_ObjectDataOffset);
 
-    vkCmdBeginRendering(cmd, &renderInfo);
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindIndexBuffer(cmd, m_BasicMesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    vkCmdPushConstants(cmd, m_DepthPrepassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(VertexPushConstant), &pushConstantData);
+
+    vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, objectCount, 0, 0, firstObject);
+}
+
+void Engine::recordGBuffer(VkCommandBuffer cmd, uint32_t firstObject, uint32_t objectCount)
+{
+    PROFILE_FUNCTION();
 
     VkViewport viewport{};
     viewport.x = 0;
@@ -1004,19 +1897,21 @@ void Engine::renderDeferred(VkCommandBuffer& cmd)
     VertexPushConstant pushConstantData;
 
     pushConstantData.view = m_Camera.getView();
-    pushConstantData.proj = m_Camera.getPerspective(m_Window->getSize());
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
 
     pushConstantData.cameraPos = m_Camera.getPosition();
     pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DeferredRenderPipeline);
 
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DeferredRenderPipelineLayout, 0,
                             1, &m_DummySet, 0, nullptr);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DeferredRenderPipelineLayout, 1,
-                            1, &m_ObjectDescriptors[m_CurrentFrame % 2], 0, nullptr);
+                            1, &m_ObjectDescriptor, 1, &m_ObjectDataOffset);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DeferredRenderPipelineLayout, 2,
-                            1, &m_MaterialDescriptors[m_CurrentFrame % 2], 0, nullptr);
+                            1, &m_MaterialDescriptor, 1, &m_MaterialDataOffset);
 
     vkCmdSetViewport(cmd, 0, 1, &viewport);
     vkCmdSetScissor(cmd, 0, 1, &scissor);
@@ -1026,46 +1921,117 @@ void Engine::renderDeferred(VkCommandBuffer& cmd)
     vkCmdPushConstants(cmd, m_DeferredRenderPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
                        sizeof(VertexPushConstant), &pushConstantData);
 
-    vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, m_ObjectCount, 0, 0, 0);
+    // The shaders index object data with gl_InstanceIndex, which includes firstInstance. The
+    // visibility shaders pull indices themselves, a triangle's is gl_VertexIndex / 3
+    if (m_Config.gBufferLayout == GBufferLayout::Visibility)
+        vkCmdDraw(cmd, m_BasicMesh.indexCount, objectCount, 0, firstObject);
+    else
+        vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, objectCount, 0, 0, firstObject);
+}
 
-    vkCmdEndRendering(cmd);
+void Engine::recordForward(VkCommandBuffer cmd, uint32_t firstObject, uint32_t objectCount)
+{
+    PROFILE_FUNCTION();
+
+    VkViewport viewport{};
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = m_DrawImage.imageExtent.width;
+    viewport.height = m_DrawImage.imageExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset.x = 0.0f;
+    scissor.offset.y = 0.0f;
+    scissor.extent.width = m_DrawImage.imageExtent.width;
+    scissor.extent.height = m_DrawImage.imageExtent.height;
+
+    VertexPushConstant pushConstantData{};
+    pushConstantData.view = m_Camera.getView();
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
+    pushConstantData.cameraPos = m_Camera.getPosition();
+    pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
+
+    std::array<uint32_t, 2> lightOffsets = { m_LightDataOffset, m_ShadowFaceDataOffset };
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ForwardPipeline);
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ForwardPipelineLayout, 0, 1,
+                            &m_LightDescriptor, static_cast<uint32_t>(lightOffsets.size()),
+                            lightOffsets.data());
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ForwardPipelineLayout, 1, 1,
+                            &m_ObjectDescriptor, 1, &m_ObjectDataOffset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ForwardPipelineLayout, 2, 1,
+                            &m_MaterialDescriptor, 1, &m_MaterialDataOffset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ForwardPipelineLayout, 3, 1,
+                            &m_LightTileDescriptor, 0, nullptr);
+
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindIndexBuffer(cmd, m_BasicMesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    vkCmdPushConstants(cmd, m_ForwardPipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(VertexPushConstant), &pushConstantData);
+
+    vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, objectCount, 0, 0, firstObject);
 }
 
-void Engine::renderGeometry(VkCommandBuffer& cmd)
+void Engine::recordShadowMask(VkCommandBuffer cmd)
 {
-    VkRenderingAttachmentInfo colourAI{};
-    colourAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    colourAI.pNext = nullptr;
-    colourAI.imageView = m_DrawImage.imageView;
-    colourAI.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    colourAI.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    colourAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colourAI.clearValue.color = {
-        {0.2f, 0.2f, 0.2f, 1.0f}
-    };
+    PROFILE_FUNCTION();
 
-    VkRenderingAttachmentInfo depthAI{};
-    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    depthAI.pNext = nullptr;
-    depthAI.imageView = m_DepthImage.imageView;
-    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthAI.clearValue.depthStencil.depth = -1.0f;
+    VkExtent3D maskExtent = m_ShadowMask[0].imageExtent;
 
-    VkRenderingInfo renderInfo{};
-    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    renderInfo.pNext = nullptr;
-    renderInfo.flags = 0;
-    renderInfo.renderArea =
-        VkRect2D({ 0, 0 }, { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height });
-    renderInfo.layerCount = 1;
-    renderInfo.colorAttachmentCount = 1;
-    renderInfo.pColorAttachments = &colourAI;
-    renderInfo.pDepthAttachment = &depthAI;
-    renderInfo.pStencilAttachment = nullptr;
+    VkViewport viewport{};
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = maskExtent.width;
+    viewport.height = maskExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
 
-    vkCmdBeginRendering(cmd, &renderInfo);
+    VkRect2D scissor{};
+    scissor.offset.x = 0.0f;
+    scissor.offset.y = 0.0f;
+    scissor.extent.width = maskExtent.width;
+    scissor.extent.height = maskExtent.height;
+
+    VertexPushConstant pushConstantData{};
+    pushConstantData.view = m_Camera.getView();
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
+    pushConstantData.cameraPos = m_Camera.getPosition();
+    pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
+
+    std::array<uint32_t, 2> lightOffsets = { m_LightDataOffset, m_ShadowFaceDataOffset };
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMaskPipeline);
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMaskPipelineLayout, 0, 1,
+                            &m_LightDescriptor, static_cast<uint32_t>(lightOffsets.size()),
+                            lightOffsets.data());
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowMaskPipelineLayout, 1, 1,
+                            &m_GBufferDescriptor, 1, &m_ObjectDataOffset);
+
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdPushConstants(cmd, m_ShadowMaskPipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(VertexPushConstant), &pushConstantData);
+
+    vkCmdDraw(cmd, 6, 1, 0, 0);
+}
+
+void Engine::recordLighting(VkCommandBuffer cmd)
+{
+    PROFILE_FUNCTION();
 
     VkViewport viewport{};
     viewport.x = 0;
@@ -1084,28 +2050,38 @@ void Engine::renderGeometry(VkCommandBuffer& cmd)
     VertexPushConstant pushConstantData;
 
     pushConstantData.view = m_Camera.getView();
-    pushConstantData.proj = m_Camera.getPerspective(m_Window->getSize());
-    //
-    // pushConstantData.view = m_CameraView;
-    // pushConstantData.proj = m_CameraProjection;
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
 
     pushConstantData.cameraPos = m_Camera.getPosition();
     pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
 
+    std::array<uint32_t, 2> lightOffsets = { m_LightDataOffset, m_ShadowFaceDataOffset };
+
+    // The compute and forward paths have already shaded the draw image, only the light markers
+    // are left
+    if (!m_Config.computeLighting && m_Config.renderPath == RenderPath::Deferred)
     {
         vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SceneRenderPipeline);
 
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SceneRenderPipelineLayout,
-                                0, 1, &m_LightDescriptors[m_CurrentFrame % 2], 0, nullptr);
+                                0, 1, &m_LightDescriptor,
+                                static_cast<uint32_t>(lightOffsets.size()), lightOffsets.data());
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SceneRenderPipelineLayout,
+                                1, 1, &m_GBufferDescriptor, 1, &m_ObjectDataOffset);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SceneRenderPipelineLayout,
+                                2, 1, &m_MaterialDescriptor, 1, &m_MaterialDataOffset);
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SceneRenderPipelineLayout,
-                                1, 1, &m_GBufferDescriptor[m_CurrentFrame % 2], 0, nullptr);
+                                3, 1, &m_ShadowMaskDescriptor, 0, nullptr);
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SceneRenderPipelineLayout,
-                                2, 1, &m_MaterialDescriptors[m_CurrentFrame % 2], 0, nullptr);
+                                4, 1, &m_LightTileDescriptor, 0, nullptr);
 
         vkCmdSetViewport(cmd, 0, 1, &viewport);
         vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-        vkCmdPushConstants(cmd, m_SceneRenderPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+        vkCmdPushConstants(cmd, m_SceneRenderPipelineLayout,
+                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
                            sizeof(VertexPushConstant), &pushConstantData);
 
         vkCmdDraw(cmd, 6, 1, 0, 0);
@@ -1115,7 +2091,8 @@ void Engine::renderGeometry(VkCommandBuffer& cmd)
         vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_LightDrawPipeline);
 
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_LightDrawPipelineLayout, 0,
-                                1, &m_LightDescriptors[m_CurrentFrame % 2], 0, nullptr);
+                                1, &m_LightDescriptor, static_cast<uint32_t>(lightOffsets.size()),
+                                lightOffsets.data());
 
         vkCmdSetViewport(cmd, 0, 1, &viewport);
         vkCmdSetScissor(cmd, 0, 1, &scissor);
@@ -1127,37 +2104,368 @@ void Engine::renderGeometry(VkCommandBuffer& cmd)
 
         vkCmdDrawIndexed(cmd, m_BasicMesh.indexCount, m_LightCount, 0, 0, 0);
     }
+}
+
+void Engine::renderShadow(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries)
+{
+    VkRenderingAttachmentInfo depthAI{};
+    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAI.pNext = nullptr;
+    depthAI.imageView = m_ShadowAtlas.image.imageView;
+    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    VkRenderingInfo renderInfo{};
+    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderInfo.pNext = nullptr;
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    // Only the tiles in use are rendered
+    renderInfo.renderArea = VkRect2D({ 0, 0 }, m_ShadowAtlasUsed);
+    renderInfo.layerCount = 1;
+    renderInfo.colorAttachmentCount = 0;
+    renderInfo.pColorAttachments = nullptr;
+    renderInfo.pDepthAttachment = &depthAI;
+    renderInfo.pStencilAttachment = nullptr;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+
+    if (!secondaries.empty())
+        vkCmdExecuteCommands(cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+    vkCmdEndRendering(cmd);
+}
+
+void Engine::renderDepthPrepass(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries)
+{
+    VkRenderingAttachmentInfo depthAI{};
+    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAI.pNext = nullptr;
+    depthAI.imageView = m_DepthImage.imageView;
+    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAI.clearValue.depthStencil.depth = 0.0f;
+
+    VkRenderingInfo renderInfo{};
+    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderInfo.pNext = nullptr;
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    renderInfo.renderArea =
+        VkRect2D({ 0, 0 }, { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height });
+    renderInfo.layerCount = 1;
+    renderInfo.colorAttachmentCount = 0;
+    renderInfo.pColorAttachments = nullptr;
+    renderInfo.pDepthAttachment = &depthAI;
+    renderInfo.pStencilAttachment = nullptr;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+
+    if (!secondaries.empty())
+        vkCmdExecuteCommands(cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+    vkCmdEndRendering(cmd);
+}
+
+void Engine::renderDeferred(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries)
+{
+    // Cleared to zero, which is the same bits in every target format
+    std::vector<VkRenderingAttachmentInfo> colourAttachments;
+    for (AllocatedImage* target : getGBufferTargets())
+    {
+        VkRenderingAttachmentInfo targetAI{};
+        targetAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        targetAI.pNext = nullptr;
+        targetAI.imageView = target->imageView;
+        targetAI.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        targetAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        targetAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        targetAI.clearValue.color = {
+            {0.0f, 0.0f, 0.0f, 0.0f}
+        };
+        colourAttachments.push_back(targetAI);
+    }
+
+    VkRenderingAttachmentInfo depthAI{};
+    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAI.pNext = nullptr;
+    depthAI.imageView = m_DepthImage.imageView;
+    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAI.clearValue.depthStencil.depth = 0.0f;
+
+    VkRenderingInfo renderInfo{};
+    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderInfo.pNext = nullptr;
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    renderInfo.renderArea =
+        VkRect2D({ 0, 0 }, { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height });
+    renderInfo.layerCount = 1;
+    renderInfo.colorAttachmentCount = static_cast<uint32_t>(colourAttachments.size());
+    renderInfo.pColorAttachments = colourAttachments.data();
+    renderInfo.pDepthAttachment = &depthAI;
+    renderInfo.pStencilAttachment = nullptr;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+
+    if (!secondaries.empty())
+        vkCmdExecuteCommands(cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+    vkCmdEndRendering(cmd);
+}
+
+void Engine::renderShadowMask(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries)
+{
+    std::array<VkRenderingAttachmentInfo, m_ShadowMaskImageCount> colourAttachments{};
+    for (size_t i = 0; i < colourAttachments.size(); i++)
+    {
+        VkRenderingAttachmentInfo& maskAI = colourAttachments[i];
+        maskAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        maskAI.pNext = nullptr;
+        maskAI.imageView = m_ShadowMask[i].imageView;
+        maskAI.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        maskAI.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        maskAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
+    VkExtent3D maskExtent = m_ShadowMask[0].imageExtent;
+
+    VkRenderingInfo renderInfo{};
+    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderInfo.pNext = nullptr;
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    renderInfo.renderArea = VkRect2D({ 0, 0 }, { maskExtent.width, maskExtent.height });
+    renderInfo.layerCount = 1;
+    renderInfo.colorAttachmentCount = static_cast<uint32_t>(colourAttachments.size());
+    renderInfo.pColorAttachments = colourAttachments.data();
+    renderInfo.pDepthAttachment = nullptr;
+    renderInfo.pStencilAttachment = nullptr;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+
+    if (!secondaries.empty())
+        vkCmdExecuteCommands(cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+    vkCmdEndRendering(cmd);
+}
+
+std::vector<AllocatedImage*> Engine::getGBufferTargets()
+{
+    if (m_Config.gBufferLayout == GBufferLayout::Compact)
+        return { &m_GBuffer.normal, &m_GBuffer.texData };
+    if (m_Config.gBufferLayout == GBufferLayout::Visibility) return { &m_GBuffer.visibility };
+    return { &m_GBuffer.position, &m_GBuffer.normal, &m_GBuffer.texData };
+}
+
+VkExtent2D Engine::getLightTileCount() const
+{
+    return { (m_Config.extent.width + m_LightTileSize - 1) / m_LightTileSize,
+             (m_Config.extent.height + m_LightTileSize - 1) / m_LightTileSize };
+}
+
+void Engine::renderLightCulling(VkCommandBuffer cmd)
+{
+    PROFILE_FUNCTION();
+
+    // The previous frame's lighting pass may still be reading the lists, as fragment or compute
+    VkMemoryBarrier2 writeBarrier{};
+    writeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    writeBarrier.pNext = nullptr;
+    writeBarrier.srcStageMask =
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    writeBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+    writeBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    writeBarrier.dstAccessMask = VK_ACCESS_2_NONE;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.pNext = nullptr;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &writeBarrier;
+
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+    VertexPushConstant pushConstantData{};
+    pushConstantData.view = m_Camera.getView();
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
+    pushConstantData.cameraPos = m_Camera.getPosition();
+    pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
+
+    std::array<uint32_t, 2> lightOffsets = { m_LightDataOffset, m_ShadowFaceDataOffset };
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightCullingPipeline);
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightCullingPipelineLayout, 0,
+                            1, &m_LightDescriptor, static_cast<uint32_t>(lightOffsets.size()),
+                            lightOffsets.data());
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightCullingPipelineLayout, 1,
+                            1, &m_GBufferDescriptor, 1, &m_ObjectDataOffset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightCullingPipelineLayout, 2,
+                            1, &m_LightTileDescriptor, 0, nullptr);
+
+    vkCmdPushConstants(cmd, m_LightCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(VertexPushConstant), &pushConstantData);
+
+    VkExtent2D tileCount = getLightTileCount();
+    vkCmdDispatch(cmd, tileCount.width, tileCount.height, 1);
+
+    VkMemoryBarrier2 readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    readBarrier.pNext = nullptr;
+    readBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    readBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    readBarrier.dstStageMask =
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+    dependencyInfo.pMemoryBarriers = &readBarrier;
+
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+}
+
+void Engine::renderLightingCompute(VkCommandBuffer cmd)
+{
+    PROFILE_FUNCTION();
+
+    VertexPushConstant pushConstantData{};
+    pushConstantData.view = m_Camera.getView();
+    pushConstantData.proj = m_Camera.getPerspective(
+        { (int)m_Config.extent.width, (int)m_Config.extent.height });
+    pushConstantData.cameraPos = m_Camera.getPosition();
+    pushConstantData.vertexBuffer = m_BasicMesh.vertexBufferAddress;
+    pushConstantData.indexBuffer = m_BasicMesh.indexBufferAddress;
+
+    std::array<uint32_t, 2> lightOffsets = { m_LightDataOffset, m_ShadowFaceDataOffset };
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipeline);
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipelineLayout,
+                            0, 1, &m_LightDescriptor, static_cast<uint32_t>(lightOffsets.size()),
+                            lightOffsets.data());
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipelineLayout,
+                            1, 1, &m_GBufferDescriptor, 1, &m_ObjectDataOffset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipelineLayout,
+                            2, 1, &m_MaterialDescriptor, 1, &m_MaterialDataOffset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipelineLayout,
+                            3, 1, &m_ShadowMaskDescriptor, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipelineLayout,
+                            4, 1, &m_LightTileDescriptor, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_LightingComputePipelineLayout,
+                            5, 1, &m_DrawImageDescriptor, 0, nullptr);
+
+    vkCmdPushConstants(cmd, m_LightingComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(VertexPushConstant), &pushConstantData);
+
+    VkExtent3D extent = m_DrawImage.imageExtent;
+    vkCmdDispatch(cmd, (extent.width + m_LightingGroupSize - 1) / m_LightingGroupSize,
+                  (extent.height + m_LightingGroupSize - 1) / m_LightingGroupSize, 1);
+}
+
+void Engine::renderGeometry(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries)
+{
+    VkRenderingAttachmentInfo colourAI{};
+    colourAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colourAI.pNext = nullptr;
+    colourAI.imageView = m_DrawImage.imageView;
+    colourAI.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colourAI.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    colourAI.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colourAI.clearValue.color = {
+        {0.2f, 0.2f, 0.2f, 1.0f}
+    };
+
+    VkRenderingAttachmentInfo depthAI{};
+    depthAI.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAI.pNext = nullptr;
+    depthAI.imageView = m_DepthImage.imageView;
+    depthAI.imageLayout = VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+    depthAI.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAI.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+    depthAI.clearValue.depthStencil.depth = 0.0f;
+
+    VkRenderingInfo renderInfo{};
+    renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderInfo.pNext = nullptr;
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    renderInfo.renderArea =
+        VkRect2D({ 0, 0 }, { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height });
+    renderInfo.layerCount = 1;
+    renderInfo.colorAttachmentCount = 1;
+    renderInfo.pColorAttachments = &colourAI;
+    renderInfo.pDepthAttachment = &depthAI;
+    renderInfo.pStencilAttachment = nullptr;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+
+    if (!secondaries.empty())
+        vkCmdExecuteCommands(cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
 
     vkCmdEndRendering(cmd);
 }
 
-void Engine::update()
+void Engine::update(double dt)
 {
-    static auto previousTime = std::chrono::system_clock::now();
-    auto newTime = std::chrono::system_clock::now();
-    double dt =
-        std::chrono::duration_cast<std::chrono::milliseconds>(newTime - previousTime).count();
-    previousTime = newTime;
+    PROFILE_FUNCTION();
+
     m_Camera.update(dt);
 
     m_LightTime += dt;
-    uploadLightData();
+
+    // Lights are rebuilt here while the workers pick up the object ranges
+    JobHandle objects = updateObjects();
+    updateLights();
+    m_Jobs.wait(objects);
+
+    updateShadowCache();
+    cullShadowCasters();
 }
 
 void Engine::render()
 {
-    VK_CHECK(vkWaitForFences(m_Device, 1, &getCurrentFrame().renderFence, true, 1e9));
+    PROFILE_FUNCTION();
+
+    FrameData& frame = getCurrentFrame();
+
+    // Wait for the submission that last used this frame's resources
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.pNext = nullptr;
+    waitInfo.flags = 0;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_FrameTimeline;
+    waitInfo.pValues = &frame.timelineValue;
+
+    {
+        PROFILE_ZONE("waitForFrame");
+        VK_CHECK(vkWaitSemaphores(m_Device, &waitInfo, 1e9));
+    }
 
-    uint32_t swapchainImageIndex;
+    uint32_t swapchainImageIndex = 0;
+    if (!m_Config.headless)
     {
-        VkResult result =
-            vkAcquireNextImageKHR(m_Device, m_Swapchain, 1e9, getCurrentFrame().swapchainSemaphore,
-                                  nullptr, &swapchainImageIndex);
+        PROFILE_ZONE("acquireImage");
+        VkResult result = vkAcquireNextImageKHR(m_Device, m_Swapchain, 1e9,
+                                                frame.swapchainSemaphore, nullptr,
+                                                &swapchainImageIndex);
     }
 
-    VK_CHECK(vkResetFences(m_Device, 1, &getCurrentFrame().renderFence));
+    // The timeline wait guarantees the GPU is done with this frame's ring segment and command pools
+    uploadFrameData();
 
-    VkCommandBuffer cmd = getCurrentFrame().mainCommandBuffer;
+    UploadManager::collect();
+
+    for (ThreadCommandPool& threadPool : frame.threadPools)
+    {
+        VK_CHECK(vkResetCommandPool(m_Device, threadPool.commandPool, 0));
+        threadPool.used = 0;
+    }
+
+    RecordedPasses passes = recordPasses();
+
+    VkCommandBuffer cmd = frame.mainCommandBuffer;
     VK_CHECK(vkResetCommandBuffer(cmd, 0));
 
     VkCommandBufferBeginInfo commandBufferBI{};
@@ -1168,6 +2476,10 @@ void Engine::render()
 
     VK_CHECK(vkBeginCommandBuffer(cmd, &commandBufferBI));
 
+    // Resolves the timings this frame slot recorded m_Frames.size() frames ago
+    m_GpuProfiler.beginFrame(cmd, static_cast<uint32_t>(getCurrentFrameIndex()), m_CurrentFrame);
+    uint32_t frameScope = m_GpuProfiler.beginScope(cmd, "frame");
+
     AllocatedImage::transition(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
                                VK_IMAGE_LAYOUT_GENERAL);
 
@@ -1182,49 +2494,127 @@ void Engine::render()
     range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     vkCmdClearColorImage(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearColour, 1, &range);
 
-    AllocatedImage::transition(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_GENERAL,
-                               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-
     AllocatedImage::transition(cmd, m_DepthImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
                                VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
-    AllocatedImage::transition(cmd, m_ShadowMaps.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                               VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-    renderShadow(cmd);
+    // The atlas stays readable between frames and is only touched when a face is dirty
+    if (!passes.shadow.empty())
+    {
+        VkImageLayout atlasLayout = m_ShadowAtlasInitialised
+                                        ? VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL
+                                        : VK_IMAGE_LAYOUT_UNDEFINED;
+        AllocatedImage::transition(cmd, m_ShadowAtlas.image.image, atlasLayout,
+                                   VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                                   VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        uint32_t shadowScope = m_GpuProfiler.beginScope(cmd, "shadow");
+        renderShadow(cmd, passes.shadow);
+        m_GpuProfiler.endScope(cmd, shadowScope);
+
+        AllocatedImage::transition(cmd, m_ShadowAtlas.image.image,
+                                   VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                                   VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                                   VK_IMAGE_ASPECT_DEPTH_BIT);
+        m_ShadowAtlasInitialised = true;
+    }
+
+    // The G-buffer is left untouched by the forward path, and nothing reads it there
+    bool forward = m_Config.renderPath == RenderPath::ForwardPlus;
+    if (forward)
+    {
+        uint32_t depthPrepassScope = m_GpuProfiler.beginScope(cmd, "depthPrepass");
+        renderDepthPrepass(cmd, passes.depthPrepass);
+        m_GpuProfiler.endScope(cmd, depthPrepassScope);
+    }
+    else
+    {
+        for (AllocatedImage* target : getGBufferTargets())
+        {
+            AllocatedImage::transition(cmd, target->image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                       VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        uint32_t deferredScope = m_GpuProfiler.beginScope(cmd, "deferred");
+        renderDeferred(cmd, passes.gBuffer);
+        m_GpuProfiler.endScope(cmd, deferredScope);
+
+        for (AllocatedImage* target : getGBufferTargets())
+        {
+            AllocatedImage::transition(cmd, target->image, VK_IMAGE_LAYOUT_GENERAL,
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
 
-    AllocatedImage::transition(cmd, m_ShadowMaps.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+    // Read only from here on. Light culling and the compact and visibility layouts sample it, the
+    // lighting and forward passes depth test against it
+    AllocatedImage::transition(cmd, m_DepthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
                                VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-    AllocatedImage::transition(cmd, m_GBuffer.position.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                               VK_IMAGE_LAYOUT_GENERAL);
-    AllocatedImage::transition(cmd, m_GBuffer.normal.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                               VK_IMAGE_LAYOUT_GENERAL);
-    AllocatedImage::transition(cmd, m_GBuffer.texData.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                               VK_IMAGE_LAYOUT_GENERAL);
+    uint32_t lightCullingScope = m_GpuProfiler.beginScope(cmd, "lightCulling");
+    renderLightCulling(cmd);
+    m_GpuProfiler.endScope(cmd, lightCullingScope);
 
-    renderDeferred(cmd);
+    // The lighting pass binds the mask either way, it only reads it after the pre-pass ran
+    bool shadowMask = !passes.shadowMask.empty();
+    for (AllocatedImage& mask : m_ShadowMask)
+    {
+        AllocatedImage::transition(cmd, mask.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                   shadowMask ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                              : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
 
-    AllocatedImage::transition(cmd, m_GBuffer.position.image, VK_IMAGE_LAYOUT_GENERAL,
-                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    AllocatedImage::transition(cmd, m_GBuffer.normal.image, VK_IMAGE_LAYOUT_GENERAL,
-                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    AllocatedImage::transition(cmd, m_GBuffer.texData.image, VK_IMAGE_LAYOUT_GENERAL,
-                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if (shadowMask)
+    {
+        uint32_t shadowMaskScope = m_GpuProfiler.beginScope(cmd, "shadowMask");
+        renderShadowMask(cmd, passes.shadowMask);
+        m_GpuProfiler.endScope(cmd, shadowMaskScope);
 
-    renderGeometry(cmd);
+        for (AllocatedImage& mask : m_ShadowMask)
+        {
+            AllocatedImage::transition(cmd, mask.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+
+    // Stays in GENERAL from the clear until the lighting pass is done with it
+    if (m_Config.computeLighting && !forward)
+    {
+        AllocatedImage::transition(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_GENERAL,
+                                   VK_IMAGE_LAYOUT_GENERAL);
+
+        uint32_t lightingScope = m_GpuProfiler.beginScope(cmd, "lightingCompute");
+        renderLightingCompute(cmd);
+        m_GpuProfiler.endScope(cmd, lightingScope);
+    }
 
+    AllocatedImage::transition(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_GENERAL,
+                               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+    uint32_t geometryScope = m_GpuProfiler.beginScope(cmd, forward ? "forward" : "geometry");
+    renderGeometry(cmd, passes.lighting);
+    m_GpuProfiler.endScope(cmd, geometryScope);
+
+    uint32_t blitScope = m_GpuProfiler.beginScope(cmd, "blit");
     AllocatedImage::transition(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-    AllocatedImage::transition(cmd, m_SwapchainImages[swapchainImageIndex],
-                               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    VkExtent2D drawExtent = { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height };
-    AllocatedImage::copyImgToImg(cmd, m_DrawImage.image, m_SwapchainImages[swapchainImageIndex],
-                                 drawExtent, m_SwapchainImageExtent);
+    if (!m_Config.headless)
+    {
+        AllocatedImage::transition(cmd, m_SwapchainImages[swapchainImageIndex],
+                                   VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+        VkExtent2D drawExtent = { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height };
+        AllocatedImage::copyImgToImg(cmd, m_DrawImage.image,
+                                     m_SwapchainImages[swapchainImageIndex], drawExtent,
+                                     m_SwapchainImageExtent);
 
-    AllocatedImage::transition(cmd, m_SwapchainImages[swapchainImageIndex],
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        AllocatedImage::transition(cmd, m_SwapchainImages[swapchainImageIndex],
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    }
+
+    m_GpuProfiler.endScope(cmd, blitScope);
+    m_GpuProfiler.endScope(cmd, frameScope);
 
     VK_CHECK(vkEndCommandBuffer(cmd));
 
@@ -1234,33 +2624,65 @@ void Engine::render()
     commandBufferSI.commandBuffer = cmd;
     commandBufferSI.deviceMask = 0;
 
-    VkSemaphoreSubmitInfo waitSI{};
-    waitSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-    waitSI.pNext = nullptr;
-    waitSI.semaphore = getCurrentFrame().swapchainSemaphore;
-    waitSI.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
-    waitSI.deviceIndex = 0;
-    waitSI.value = 1;
-
-    VkSemaphoreSubmitInfo signalSI{};
-    signalSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-    signalSI.pNext = nullptr;
-    signalSI.semaphore = getCurrentFrame().renderSemaphore;
-    signalSI.stageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-    signalSI.deviceIndex = 0;
-    signalSI.value = 1;
+    VkSemaphoreSubmitInfo swapchainWaitSI{};
+    swapchainWaitSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    swapchainWaitSI.pNext = nullptr;
+    swapchainWaitSI.semaphore = frame.swapchainSemaphore;
+    swapchainWaitSI.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+    swapchainWaitSI.deviceIndex = 0;
+    swapchainWaitSI.value = 1;
+
+    // Everything uploaded before this frame was recorded must land before it executes
+    VkSemaphoreSubmitInfo uploadWaitSI{};
+    uploadWaitSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    uploadWaitSI.pNext = nullptr;
+    uploadWaitSI.semaphore = UploadManager::getSemaphore();
+    uploadWaitSI.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    uploadWaitSI.deviceIndex = 0;
+    uploadWaitSI.value = UploadManager::getLastTicket();
+
+    const std::array<VkSemaphoreSubmitInfo, 2> waitSIs = { uploadWaitSI, swapchainWaitSI };
+
+    frame.timelineValue = ++m_FrameTimelineValue;
+
+    VkSemaphoreSubmitInfo timelineSignalSI{};
+    timelineSignalSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    timelineSignalSI.pNext = nullptr;
+    timelineSignalSI.semaphore = m_FrameTimeline;
+    timelineSignalSI.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    timelineSignalSI.deviceIndex = 0;
+    timelineSignalSI.value = frame.timelineValue;
+
+    VkSemaphoreSubmitInfo presentSignalSI{};
+    presentSignalSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    presentSignalSI.pNext = nullptr;
+    presentSignalSI.semaphore = m_PresentSemaphores[swapchainImageIndex];
+    presentSignalSI.stageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
+    presentSignalSI.deviceIndex = 0;
+    presentSignalSI.value = 0;
+
+    const std::array<VkSemaphoreSubmitInfo, 2> signalSIs = { timelineSignalSI, presentSignalSI };
+
+    // Headless frames have no swapchain semaphores, which sit at the end of both arrays
+    const uint32_t semaphoreCount = m_Config.headless ? 1 : 2;
 
     VkSubmitInfo2 submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
     submitInfo.pNext = nullptr;
-    submitInfo.waitSemaphoreInfoCount = 1;
-    submitInfo.pWaitSemaphoreInfos = &waitSI;
-    submitInfo.signalSemaphoreInfoCount = 1;
-    submitInfo.pSignalSemaphoreInfos = &signalSI;
+    submitInfo.waitSemaphoreInfoCount = semaphoreCount;
+    submitInfo.pWaitSemaphoreInfos = waitSIs.data();
+    submitInfo.signalSemaphoreInfoCount = semaphoreCount;
+    submitInfo.pSignalSemaphoreInfos = signalSIs.data();
     submitInfo.commandBufferInfoCount = 1;
     submitInfo.pCommandBufferInfos = &commandBufferSI;
 
-    VK_CHECK(vkQueueSubmit2(m_GraphicsQueue, 1, &submitInfo, getCurrentFrame().renderFence));
+    VK_CHECK(vkQueueSubmit2(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    if (m_Config.headless)
+    {
+        m_CurrentFrame++;
+        return;
+    }
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1268,7 +2690,7 @@ void Engine::render()
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &m_Swapchain;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &getCurrentFrame().renderSemaphore;
+    presentInfo.pWaitSemaphores = &m_PresentSemaphores[swapchainImageIndex];
     presentInfo.pImageIndices = &swapchainImageIndex;
 
     {
@@ -1278,16 +2700,45 @@ void Engine::render()
     m_CurrentFrame++;
 }
 
-void Engine::mainLoop()
+void Engine::run()
 {
+    if (m_Config.headless)
+        throw std::runtime_error("run() needs a window, drive headless engines with step()");
+
+    PROFILE_THREAD_NAME("main");
+
+    auto previousTime = std::chrono::system_clock::now();
     while (!m_Window->shouldClose())
     {
         m_Window->getEvents();
 
-        update();
+        auto newTime = std::chrono::system_clock::now();
+        double dt =
+            std::chrono::duration_cast<std::chrono::milliseconds>(newTime - previousTime).count();
+        previousTime = newTime;
 
-        render();
+        step(dt);
 
         m_Window->swapBuffers();
     }
 }
+
+void Engine::step(double dt)
+{
+    update(dt);
+
+    render();
+}
+
+void Engine::waitIdle()
+{
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.pNext = nullptr;
+    waitInfo.flags = 0;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_FrameTimeline;
+    waitInfo.pValues = &m_FrameTimelineValue;
+
+    VK_CHECK(vkWaitSemaphores(m_Device, &waitInfo, UINT64_MAX));
+}
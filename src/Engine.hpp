@@ -4,53 +4,143 @@
 
 #include <vk_mem_alloc.h>
 
+#include <array>
 #include <memory>
+#include <span>
+#include <vector>
 
 #include "Buffer.hpp"
 #include "Camera.hpp"
 #include "Descriptors.hpp"
 #include "EventHandler.hpp"
+#include "GpuProfiler.hpp"
 #include "Image.hpp"
-#include "ImmediateSubmit.hpp"
+#include "JobSystem.hpp"
 #include "Mesh.hpp"
 #include "Pipeline.hpp"
+#include "RingBuffer.hpp"
+#include "SceneData.hpp"
+#include "ShadowAtlas.hpp"
+#include "ShadowScheduler.hpp"
+#include "StagingArena.hpp"
+#include "UploadBatch.hpp"
+#include "UploadManager.hpp"
 #include "Window.hpp"
 
+struct ThreadCommandPool {
+    VkCommandPool commandPool;
+    std::vector<VkCommandBuffer> commandBuffers;
+    size_t used = 0;
+};
+
 struct FrameData {
     VkCommandPool commandPool;
     VkCommandBuffer mainCommandBuffer;
 
-    VkFence renderFence;
+    // Secondary command buffers, one pool per recording thread
+    std::vector<ThreadCommandPool> threadPools;
+
     VkSemaphore swapchainSemaphore;
-    VkSemaphore renderSemaphore;
+
+    // Value m_FrameTimeline reaches once this frame's last submission has finished
+    uint64_t timelineValue = 0;
+};
+
+// How the scene's surfaces are lit. Both share the object, material and light sets and the tiled
+// light lists, only the deferred path can use the shadow mask
+enum class RenderPath {
+    Deferred,    // G-buffer pass, then a fullscreen or compute pass lighting each pixel once
+    ForwardPlus, // Depth prepass and light culling, then the scene is drawn again and lit
+};
+
+struct EngineConfig {
+    // Trades latency for throughput; valid range is 1 to Engine::MAX_FRAMES_IN_FLIGHT
+    uint32_t framesInFlight = 2;
+
+    // Renders into m_DrawImage only, without creating a window, surface or swapchain. Frames
+    // are driven through step() instead of run()
+    bool headless = false;
+
+    VkExtent2D extent = { 800, 800 };
+
+    // Draws each shadow face with its own viewport even when one instanced draw could cover them
+    bool perFaceShadowDraws = false;
+
+    // Spreads the shadow faces over viewports with a geometry shader instead of clipping them
+    // into their tiles in the vertex shader. Also used when the device lacks shaderClipDistance
+    bool geometryShaderShadows = false;
+
+    // VK_FORMAT_D16_UNORM or VK_FORMAT_D32_SFLOAT
+    VkFormat shadowFormat = VK_FORMAT_D16_UNORM;
+
+    // Hardware 2x2 PCF on shadow lookups. Ignored when the device cannot linearly filter
+    // shadowFormat, which is optional for D32
+    bool shadowPcf = true;
+
+    // Most stale shadow faces refreshed per frame, by count and by measured GPU time. 0 leaves
+    // either unlimited. Faces without usable contents are always drawn
+    uint32_t shadowFaceBudget = 0;
+    double shadowBudgetMs = 0.0;
+
+    // Evaluates shadows of the first lights at half resolution before the lighting pass, which
+    // then upsamples them instead of sampling the atlas per pixel. Lights past the mask's
+    // capacity are still shadowed per pixel
+    bool shadowMask = false;
+
+    // Brightness below which a light no longer contributes, which sets the radius of every point
+    // and spot light. Lights whose radius misses the camera frustum are dropped for the frame
+    float lightCutoff = 1.0f / 256.0f;
+
+    // Shades the G-buffer with a compute pass writing straight into the draw image instead of a
+    // fullscreen draw. Can be switched between frames with Engine::setComputeLighting
+    bool computeLighting = false;
+
+    // Small unshadowed point lights scattered through the scene on top of the hand placed ones,
+    // for loading up light culling. The total is capped at Engine::m_MaxLights
+    uint32_t fillLights = 0;
+
+    // What the G-buffer pass writes per pixel, see GBufferLayout. Every layout other than Full
+    // rebuilds positions from the depth image. Fixed for the engine's lifetime
+    GBufferLayout gBufferLayout = GBufferLayout::Full;
+
+    // Can be switched between frames with Engine::setRenderPath
+    RenderPath renderPath = RenderPath::Deferred;
+
+    // Job system workers running frame work alongside the main thread. 0 uses one less than the
+    // number of hardware threads
+    uint32_t workerThreads = 0;
 };
 
-struct ObjectData {
-    alignas(16) int materialIndex;
-    alignas(16) glm::vec4 colour;
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 rotation;
+// What a cached shadow face was last rendered with
+struct ShadowFaceState {
+    ShadowTile tile;
+    glm::mat4 viewProj;
+    uint32_t light = UINT32_MAX; // Scene index of the light it was rendered for
+    bool valid = false;
+
+    // Out of date but still usable while it waits for the scheduler
+    bool stale = false;
 };
 
-struct LightGeneralData {
-    alignas(16) int lightCount;
-    alignas(16) glm::vec4 ambient;
+// Which light an entry of the shadow face table belongs to, and which of its faces it is
+struct ShadowFaceOwner {
+    uint32_t light;
+    uint32_t face;
 };
 
-struct LightData {
-    alignas(16) glm::vec3 position;
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::vec3 diffuse;
-    alignas(16) glm::vec3 specular;
-    alignas(16) glm::vec3 attenuation;
-    alignas(16) glm::mat4 proj;
-    alignas(16) glm::mat4 view[6];
+// A dirty shadow face and the run of m_ShadowCasters that reaches into it
+struct ShadowFaceDraw {
+    uint32_t face;
+    uint32_t firstCaster;
+    uint32_t casterCount;
 };
 
-struct MaterialData {
-    alignas(16) glm::vec3 ambient;
-    alignas(16) glm::vec3 diffuse;
-    alignas(16) glm::vec4 specular;
+struct RecordedPasses {
+    std::vector<VkCommandBuffer> shadow;
+    std::vector<VkCommandBuffer> depthPrepass;
+    std::vector<VkCommandBuffer> gBuffer;
+    std::vector<VkCommandBuffer> shadowMask;
+    std::vector<VkCommandBuffer> lighting;
 };
 
 struct Vertex {
@@ -64,27 +154,80 @@ struct VertexPushConstant {
     alignas(8) glm::mat4 proj;
     alignas(8) glm::vec3 cameraPos;
     alignas(8) VkDeviceAddress vertexBuffer;
+    alignas(8) VkDeviceAddress indexBuffer; // Read by the visibility layout, see gbuffer.glsl
 };
 
+// Faces one geometry shader shadow draw covers, matches MAX_SHADOW_VIEWPORTS in shadow.geo.glsl
+constexpr uint32_t MAX_SHADOW_VIEWPORTS = 16;
+
 struct ShadowPushConstant {
     alignas(8) VkDeviceAddress vertexBuffer;
-    alignas(8) glm::ivec2 currentLight;
+
+    // Shadow face drawn into each viewport, only read by the geometry shader path
+    uint32_t viewportFaces[MAX_SHADOW_VIEWPORTS];
 };
 
 struct gBuffer {
-    AllocatedImage position;
+    AllocatedImage position; // Only created by the full layout, the others read depth instead
     AllocatedImage normal;
     AllocatedImage texData;
+    AllocatedImage visibility; // The visibility layout's only target
 };
 
 class Engine : public EventObserver
 {
   public:
-    Engine();
+    Engine(const EngineConfig& config = {});
     virtual ~Engine();
 
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
     void receiveEvent(const Event* event) override;
 
+    // Runs until the window is closed, stepping with wall clock time
+    void run();
+
+    // Advances the scene by dt milliseconds and submits one frame
+    void step(double dt);
+
+    // Blocks until every submitted frame has finished on the GPU
+    void waitIdle();
+
+    // Left in TRANSFER_SRC_OPTIMAL at the end of each frame
+    const AllocatedImage& getDrawImage() const { return m_DrawImage; }
+    size_t getFrameCount() const { return m_CurrentFrame; }
+
+    Camera& getCamera() { return m_Camera; }
+
+    // Overrides the time the animated lights are evaluated at, in milliseconds
+    void setLightTime(float time) { m_LightTime = time; }
+
+    // Picks the lighting pass recorded from the next frame on, see EngineConfig::computeLighting
+    void setComputeLighting(bool enabled) { m_Config.computeLighting = enabled; }
+    bool getComputeLighting() const { return m_Config.computeLighting; }
+
+    // Picks the renderer used from the next frame on, e.g. per camera or per scene
+    void setRenderPath(RenderPath path) { m_Config.renderPath = path; }
+    RenderPath getRenderPath() const { return m_Config.renderPath; }
+
+    // Holds a "frame" scope plus one scope per pass
+    const GpuProfiler& getGpuProfiler() const { return m_GpuProfiler; }
+
+    const ShadowAtlas& getShadowAtlas() const { return m_ShadowAtlas; }
+
+    // Which shadow faces the last update refreshed and how many it put off
+    const ShadowUpdateReport& getShadowUpdateReport() const
+    {
+        return m_ShadowScheduler.getReport();
+    }
+
+    // Caster instances the last update sent to the shadow pass
+    size_t getShadowCasterCount() const { return m_ShadowCasters.size(); }
+
+    // Lights that survived frustum culling in the last update, out of getSceneLightCount
+    size_t getLightCount() const { return m_LightCount; }
+    size_t getSceneLightCount() const { return m_SceneLightCount; }
+
   private:
     void cleanup();
 
@@ -99,33 +242,69 @@ class Engine : public EventObserver
 
     void initDescriptorSetLayouts();
 
-    void initTextures();
+    void initTextures(UploadBatch& uploads);
 
     void createMaterials();
     void createObjects();
+    JobHandle updateObjects();
 
     void createLights();
-    void uploadLightData();
+    void updateLights();
+    void updateShadowAtlas();
+    void updateShadowCache();
+    void cullShadowCasters();
+
+    void initFrameData();
+    void uploadFrameData();
 
     void initPipelines();
 
     void initDescriptorPool();
     void initDescriptorSets();
 
-    void createMesh();
+    void createMesh(UploadBatch& uploads);
 
-    FrameData& getCurrentFrame();
+    VkShaderStageFlags getShadowPushConstantStages() const
+    {
+        return VK_SHADER_STAGE_VERTEX_BIT | (m_GeometryShadows ? VK_SHADER_STAGE_GEOMETRY_BIT : 0);
+    }
 
-    void renderShadow(VkCommandBuffer& cmd);
-    void renderDeferred(VkCommandBuffer& cmd);
-    void renderGeometry(VkCommandBuffer& cmd);
+    // Every object in six faces of every shadowed light, the most culling can ever produce
+    size_t getMaxShadowCasters() const { return m_ObjectCount * m_MaxShadowedLights * 6; }
 
-    void update();
+    // Row by row over the draw image, as lightTiles.glsl indexes them
+    VkExtent2D getLightTileCount() const;
+
+    // Colour targets of the G-buffer pass in attachment order
+    std::vector<AllocatedImage*> getGBufferTargets();
+
+    size_t getCurrentFrameIndex() const;
+    FrameData& getCurrentFrame();
+
+    VkCommandBuffer beginSecondary(size_t thread, std::span<const VkFormat> colourFormats,
+                                   VkFormat depthFormat);
+    RecordedPasses recordPasses();
+
+    void recordShadow(VkCommandBuffer cmd, std::span<const ShadowFaceDraw> draws);
+    void recordDepthPrepass(VkCommandBuffer cmd, uint32_t firstObject, uint32_t objectCount);
+    void recordGBuffer(VkCommandBuffer cmd, uint32_t firstObject, uint32_t objectCount);
+    void recordForward(VkCommandBuffer cmd, uint32_t firstObject, uint32_t objectCount);
+    void recordShadowMask(VkCommandBuffer cmd);
+    void recordLighting(VkCommandBuffer cmd);
+
+    void renderShadow(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries);
+    void renderDepthPrepass(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries);
+    void renderDeferred(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries);
+    void renderShadowMask(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries);
+    void renderLightCulling(VkCommandBuffer cmd);
+    void renderLightingCompute(VkCommandBuffer cmd);
+    void renderGeometry(VkCommandBuffer cmd, std::span<const VkCommandBuffer> secondaries);
+
+    void update(double dt);
     void render();
-    void mainLoop();
 
   private:
-    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+    EngineConfig m_Config;
 
     std::unique_ptr<Window> m_Window;
 
@@ -136,18 +315,37 @@ class Engine : public EventObserver
     VkSurfaceKHR m_Surface;
     VkQueue m_GraphicsQueue;
     uint32_t m_GraphicsQueueFamily;
+    VkQueue m_TransferQueue;
+    uint32_t m_TransferQueueFamily;
+    bool m_CalibratedTimestamps = false;
+    bool m_InstancedShadows = false;
+    bool m_GeometryShadows = false;
+    uint32_t m_ShadowViewportCount = 1; // Viewports per geometry shader shadow draw
     VmaAllocator m_Allocator;
 
+    static constexpr size_t m_StagingChunkSize = 16 * 1024 * 1024;
+    StagingArena m_StagingArena;
+
     VkSwapchainKHR m_Swapchain;
     VkFormat m_SwapchainImageFormat;
     std::vector<VkImage> m_SwapchainImages;
     std::vector<VkImageView> m_SwapchainImageViews;
+    std::vector<VkSemaphore> m_PresentSemaphores;
     VkExtent2D m_SwapchainImageExtent;
 
     gBuffer m_GBuffer;
     AllocatedImage m_DrawImage;
     AllocatedImage m_DepthImage;
 
+    // Half resolution shadow visibility, four lights per image
+    static constexpr size_t m_ShadowMaskImageCount = 3;
+    std::array<AllocatedImage, m_ShadowMaskImageCount> m_ShadowMask;
+
+    // Per tile light lists, written and read on the GPU within a frame. Sizes match lightTiles.glsl
+    static constexpr uint32_t m_LightTileSize = 16;
+    static constexpr uint32_t m_MaxLightsPerTile = 256;
+    AllocatedBuffer m_LightTiles;
+
     AllocatedImage m_BoxTexture;
     AllocatedImage m_FaceTexture;
 
@@ -157,46 +355,140 @@ class Engine : public EventObserver
     VkDescriptorSet m_DummySet;
 
     VkDescriptorSetLayout m_GBufferDescriptorLayout;
-    std::vector<VkDescriptorSet> m_GBufferDescriptor;
+    VkDescriptorSet m_GBufferDescriptor;
 
     VkDescriptorSetLayout m_ObjectDescriptorLayout;
-    std::vector<VkDescriptorSet> m_ObjectDescriptors;
+    VkDescriptorSet m_ObjectDescriptor;
 
     VkDescriptorSetLayout m_LightDescriptorLayout;
-    std::vector<VkDescriptorSet> m_LightDescriptors;
+    VkDescriptorSet m_LightDescriptor;
 
     VkDescriptorSetLayout m_MaterialDescriptorLayout;
-    std::vector<VkDescriptorSet> m_MaterialDescriptors;
+    VkDescriptorSet m_MaterialDescriptor;
 
-    size_t m_ObjectCount;
-    std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> m_ObjectDataBuffer;
+    VkDescriptorSetLayout m_ShadowCasterDescriptorLayout;
+    VkDescriptorSet m_ShadowCasterDescriptor;
 
-    static constexpr size_t m_MaxLights = 10;
+    VkDescriptorSetLayout m_ShadowMaskDescriptorLayout;
+    VkDescriptorSet m_ShadowMaskDescriptor;
+
+    VkDescriptorSetLayout m_LightTileDescriptorLayout;
+    VkDescriptorSet m_LightTileDescriptor;
+
+    VkDescriptorSetLayout m_DrawImageDescriptorLayout;
+    VkDescriptorSet m_DrawImageDescriptor;
+
+    RingBuffer m_FrameDataRing;
+    uint32_t m_ObjectDataOffset = 0;
+    uint32_t m_LightDataOffset = 0;
+    uint32_t m_ShadowFaceDataOffset = 0;
+    uint32_t m_MaterialDataOffset = 0;
+    uint32_t m_ShadowCasterOffset = 0;
+
+    size_t m_ObjectCount;
+    std::vector<ObjectTransform> m_ObjectTransforms;
+    std::vector<ObjectData> m_Objects;
+    std::vector<glm::vec4> m_ObjectBounds;
+
+    // Lights past the first m_MaxShadowedLights with shadows are lit without them
+    static constexpr size_t m_MaxLights = 4096;
+    static constexpr size_t m_MaxShadowedLights = 10;
+    static constexpr float m_MaxLightRadius = 40.0f;
     size_t m_LightCount = 0;
+    size_t m_SceneLightCount = 0;
     float m_LightTime = 0.0f;
-    std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> m_LightDataBuffer;
-    AllocatedImage m_ShadowMaps;
+    LightGeneralData m_LightGeneralData;
+    // Only the lights reaching into the camera frustum, everything after updateLights sees these
+    std::vector<LightData> m_Lights;
+    std::vector<uint32_t> m_LightSceneIndices; // Parallel to m_Lights
+    // Hand placed lights, refilled each frame as some are animated. The fill lights follow them
+    // in scene index order and never change, so their radii are only computed once
+    std::vector<LightData> m_SceneLights;
+    std::vector<LightData> m_FillLights;
+    // Point lights have six faces and the rest one, starting at each LightData::shadowIndex
+    std::vector<ShadowFaceData> m_ShadowFaceData;
+    std::vector<ShadowFaceOwner> m_ShadowFaceOwners;
+
+    // Tile sizes halve each time a light's distance from the camera doubles past this
+    static constexpr float m_ShadowFullResDistance = 8.0f;
+    static constexpr uint32_t m_MaxShadowTileSize = 1024;
+    static constexpr uint32_t m_MinShadowTileSize = 128;
+    ShadowAtlas m_ShadowAtlas;
+    VkExtent2D m_ShadowAtlasUsed = { 0, 0 };
+    std::vector<ShadowTile> m_ShadowTiles; // Parallel to m_ShadowFaceData
+    std::vector<uint32_t> m_ShadowTileSizes; // Packing input, rebuilt each frame
+
+    // Faces keep their depth between frames and are only redrawn once their light, tile or a
+    // caster reaching into them changes
+    std::vector<ShadowFaceState> m_ShadowFaces;
+    std::vector<uint32_t> m_DirtyShadowFaces; // Ascending shadow face table indices
+    std::vector<glm::vec3> m_PreviousLightPositions; // By scene index, culled lights included
+    ShadowScheduler m_ShadowScheduler;
+    std::vector<ObjectTransform> m_ShadowCasterTransforms;
+
+    // Per-frame scratch for the cache update, kept so their capacity carries over between frames
+    std::vector<glm::vec4> m_ChangedCasterBounds;
+    std::vector<ShadowFaceRequest> m_ShadowRequests;
+    bool m_ShadowAtlasInitialised = false;
+
+    // Objects culled against each dirty face, grouped by face in the order of m_ShadowDraws
+    std::vector<ShadowCaster> m_ShadowCasters;
+    std::vector<ShadowFaceDraw> m_ShadowDraws;
 
     static constexpr size_t m_MaxMaterials = 10;
-    std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> m_MaterialDataBuffer;
+    std::vector<MaterialData> m_Materials;
 
     VkPipelineLayout m_ShadowMapPipelineLayout;
     VkPipeline m_ShadowMapPipeline;
 
+    VkPipelineLayout m_DepthPrepassPipelineLayout;
+    VkPipeline m_DepthPrepassPipeline;
+
     VkPipelineLayout m_DeferredRenderPipelineLayout;
     VkPipeline m_DeferredRenderPipeline;
 
+    VkPipelineLayout m_ShadowMaskPipelineLayout;
+    VkPipeline m_ShadowMaskPipeline;
+
+    VkPipelineLayout m_LightCullingPipelineLayout;
+    VkPipeline m_LightCullingPipeline;
+
+    VkPipelineLayout m_LightingComputePipelineLayout;
+    VkPipeline m_LightingComputePipeline;
+
+    // Matches the workgroup size in lighting.comp.glsl
+    static constexpr uint32_t m_LightingGroupSize = 8;
+
+    // Triangles a mesh can have in the visibility layout, see VISIBILITY_TRIANGLE_BITS
+    static constexpr uint32_t m_MaxVisibilityTriangles = 4096;
+
     VkPipelineLayout m_SceneRenderPipelineLayout;
     VkPipeline m_SceneRenderPipeline;
 
+    VkPipelineLayout m_ForwardPipelineLayout;
+    VkPipeline m_ForwardPipeline;
+
     VkPipelineLayout m_LightDrawPipelineLayout;
     VkPipeline m_LightDrawPipeline;
 
     Mesh m_BasicMesh;
 
     Camera m_Camera;
-    glm::mat4 m_CameraView, m_CameraProjection;
 
     size_t m_CurrentFrame = 0;
-    std::array<FrameData, MAX_FRAMES_IN_FLIGHT> m_Frames;
+    std::vector<FrameData> m_Frames;
+
+    VkSemaphore m_FrameTimeline;
+    uint64_t m_FrameTimelineValue = 0;
+
+    GpuProfiler m_GpuProfiler;
+
+    JobSystem m_Jobs;
+
+    // Items per job when updating object and light matrices
+    static constexpr size_t m_ObjectsPerJob = 256;
+    static constexpr size_t m_LightsPerJob = 16;
+
+    // Smallest number of objects worth a G-buffer secondary command buffer of its own
+    static constexpr size_t m_MinObjectsPerRange = 64;
 };
@@ -0,0 +1,258 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+#include <format>
+#include <numeric>
+
+#include "ErrorCheck.hpp"
+
+void GpuProfiler::create(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice,
+                         uint32_t queueFamily, uint32_t frameCount, bool calibratedTimestamps)
+{
+    m_Device = device;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    // Scopes are simply not recorded on queues without timestamp support
+    uint32_t validBits = families[queueFamily].timestampValidBits;
+    if (validBits == 0) return;
+
+    m_TimestampMask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_NsPerTick = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolCI{};
+    queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCI.pNext = nullptr;
+    queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCI.queryCount = m_MaxQueriesPerFrame * frameCount;
+
+    VK_CHECK(vkCreateQueryPool(m_Device, &queryPoolCI, nullptr, &m_QueryPool));
+
+    m_Slots.resize(frameCount);
+    for (FrameSlot& slot : m_Slots)
+    {
+        slot.frameNumber = 0;
+        slot.pending = false;
+        slot.queryCount = 0;
+        slot.openScopes = 0;
+    }
+
+    // Only CLOCK_MONOTONIC is handled, which is what std::chrono::steady_clock reads on Linux.
+    // Devices that cannot calibrate against it keep uncalibrated timestamps
+#ifndef _WIN32
+    if (calibratedTimestamps && supportsHostDomain(instance, physicalDevice))
+    {
+        m_GetCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+            vkGetDeviceProcAddr(m_Device, "vkGetCalibratedTimestampsEXT"));
+        m_HostDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        m_Calibrated = m_GetCalibratedTimestamps != nullptr;
+
+        if (m_Calibrated) calibrate();
+    }
+#endif
+}
+
+void GpuProfiler::destroy()
+{
+    if (m_QueryPool) vkDestroyQueryPool(m_Device, m_QueryPool, nullptr);
+    m_QueryPool = VK_NULL_HANDLE;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frameIndex, uint64_t frameNumber)
+{
+    if (!isEnabled()) return;
+
+    m_CurrentSlot = frameIndex;
+
+    FrameSlot& slot = m_Slots[frameIndex];
+    if (slot.pending) resolve(frameIndex);
+
+    vkCmdResetQueryPool(cmd, m_QueryPool, frameIndex * m_MaxQueriesPerFrame, m_MaxQueriesPerFrame);
+
+    slot.frameNumber = frameNumber;
+    slot.pending = true;
+    slot.queryCount = 0;
+    slot.openScopes = 0;
+    slot.scopes.clear();
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer cmd, const char* name, VkPipelineStageFlags2 stage)
+{
+    if (!isEnabled()) return UINT32_MAX;
+
+    FrameSlot& slot = m_Slots[m_CurrentSlot];
+    // Room for this scope's begin and end, plus the end of every scope it is nested in
+    if (slot.queryCount + slot.openScopes + 2 > m_MaxQueriesPerFrame) return UINT32_MAX;
+
+    uint32_t query = slot.queryCount++;
+    slot.openScopes++;
+    vkCmdWriteTimestamp2(cmd, stage, m_QueryPool, m_CurrentSlot * m_MaxQueriesPerFrame + query);
+
+    slot.scopes.push_back(
+        { .scope = findScope(name), .beginQuery = query, .endQuery = UINT32_MAX });
+
+    return static_cast<uint32_t>(slot.scopes.size() - 1);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd, uint32_t scope, VkPipelineStageFlags2 stage)
+{
+    if (scope == UINT32_MAX) return;
+
+    FrameSlot& slot = m_Slots[m_CurrentSlot];
+
+    // beginScope() leaves room for the matching end query
+    uint32_t query = slot.queryCount++;
+    slot.openScopes--;
+    vkCmdWriteTimestamp2(cmd, stage, m_QueryPool, m_CurrentSlot * m_MaxQueriesPerFrame + query);
+
+    slot.scopes[scope].endQuery = query;
+}
+
+const GpuScopeStats* GpuProfiler::findStats(const std::string& name) const
+{
+    for (const GpuScopeStats& stats : m_Stats)
+    {
+        if (stats.name == name) return &stats;
+    }
+
+    return nullptr;
+}
+
+void GpuProfiler::exportJson(std::ostream& out) const
+{
+    out << std::format("{{\n  \"calibrated\": {},\n  \"lastResolvedFrame\": {},\n  \"scopes\": [",
+                       m_Calibrated, m_LastResolvedFrame);
+
+    for (size_t i = 0; i < m_Stats.size(); i++)
+    {
+        const GpuScopeStats& stats = m_Stats[i];
+        out << std::format("{}\n    {{ \"name\": \"{}\", \"lastMs\": {:.4f}, \"meanMs\": {:.4f}, "
+                           "\"minMs\": {:.4f}, \"maxMs\": {:.4f} }}",
+                           i == 0 ? "" : ",", stats.name, stats.lastMs, stats.meanMs, stats.minMs,
+                           stats.maxMs);
+    }
+
+    out << "\n  ],\n  \"lastFrame\": [";
+
+    for (size_t i = 0; i < m_LastFrameEvents.size(); i++)
+    {
+        const GpuScopeEvent& event = m_LastFrameEvents[i];
+        out << std::format("{}\n    {{ \"name\": \"{}\", \"beginNs\": {}, \"endNs\": {} }}",
+                           i == 0 ? "" : ",", m_Stats[event.scope].name, event.beginNs,
+                           event.endNs);
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+bool GpuProfiler::supportsHostDomain(VkInstance instance, VkPhysicalDevice physicalDevice)
+{
+    auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    if (!getTimeDomains) return false;
+
+    uint32_t domainCount = 0;
+    if (getTimeDomains(physicalDevice, &domainCount, nullptr) != VK_SUCCESS) return false;
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    if (getTimeDomains(physicalDevice, &domainCount, domains.data()) != VK_SUCCESS) return false;
+
+    auto supports = [&domains](VkTimeDomainEXT domain) {
+        return std::find(domains.begin(), domains.end(), domain) != domains.end();
+    };
+    return supports(VK_TIME_DOMAIN_DEVICE_EXT) && supports(VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT);
+}
+
+void GpuProfiler::resolve(uint32_t frameIndex)
+{
+    FrameSlot& slot = m_Slots[frameIndex];
+    slot.pending = false;
+
+    if (slot.queryCount == 0) return;
+
+    std::array<uint64_t, m_MaxQueriesPerFrame> timestamps;
+    VkResult result = vkGetQueryPoolResults(
+        m_Device, m_QueryPool, frameIndex * m_MaxQueriesPerFrame, slot.queryCount,
+        sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    // Never wait, a frame that is somehow still in flight is dropped instead
+    if (result != VK_SUCCESS) return;
+
+    if (m_Calibrated) calibrate();
+
+    auto toNs = [this](uint64_t timestamp) -> int64_t {
+        if (!m_Calibrated) return static_cast<int64_t>(timestamp * m_NsPerTick);
+
+        int64_t ticks = static_cast<int64_t>(timestamp - m_CalibrationDevice);
+        return m_CalibrationHostNs + static_cast<int64_t>(ticks * m_NsPerTick);
+    };
+
+    m_LastFrameEvents.clear();
+    m_LastResolvedFrame = slot.frameNumber;
+
+    for (const RecordedScope& recorded : slot.scopes)
+    {
+        if (recorded.endQuery == UINT32_MAX) continue;
+
+        uint64_t begin = timestamps[recorded.beginQuery] & m_TimestampMask;
+        uint64_t end = timestamps[recorded.endQuery] & m_TimestampMask;
+        double ms = ((end - begin) & m_TimestampMask) * m_NsPerTick * 1e-6;
+
+        m_LastFrameEvents.push_back({ .scope = recorded.scope,
+                                      .frame = slot.frameNumber,
+                                      .beginNs = toNs(begin),
+                                      .endNs = toNs(end) });
+
+        std::array<double, m_HistorySize>& history = m_History[recorded.scope];
+        size_t& count = m_HistoryCount[recorded.scope];
+        history[count % m_HistorySize] = ms;
+        count++;
+
+        size_t samples = std::min(count, m_HistorySize);
+        GpuScopeStats& stats = m_Stats[recorded.scope];
+        stats.lastMs = ms;
+        stats.meanMs = std::accumulate(history.begin(), history.begin() + samples, 0.0) / samples;
+        stats.minMs = *std::min_element(history.begin(), history.begin() + samples);
+        stats.maxMs = *std::max_element(history.begin(), history.begin() + samples);
+    }
+}
+
+void GpuProfiler::calibrate()
+{
+    std::array<VkCalibratedTimestampInfoEXT, 2> infos{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = m_HostDomain;
+
+    std::array<uint64_t, 2> timestamps;
+    uint64_t maxDeviation;
+    if (m_GetCalibratedTimestamps(m_Device, static_cast<uint32_t>(infos.size()), infos.data(),
+                                  timestamps.data(), &maxDeviation) != VK_SUCCESS)
+    {
+        m_Calibrated = false;
+        return;
+    }
+
+    m_CalibrationDevice = timestamps[0] & m_TimestampMask;
+    m_CalibrationHostNs = static_cast<int64_t>(timestamps[1]);
+}
+
+uint32_t GpuProfiler::findScope(const char* name)
+{
+    for (size_t i = 0; i < m_Stats.size(); i++)
+    {
+        if (m_Stats[i].name == name) return static_cast<uint32_t>(i);
+    }
+
+    m_Stats.push_back({ .name = name });
+    m_History.push_back({});
+    m_HistoryCount.push_back(0);
+
+    return static_cast<uint32_t>(m_Stats.size() - 1);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct GpuScopeStats {
+    std::string name;
+    double lastMs = 0.0;
+    double meanMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+};
+
+struct GpuScopeEvent {
+    uint32_t scope;
+    uint64_t frame;
+
+    // Host clock nanoseconds when calibrated, otherwise device nanoseconds
+    int64_t beginNs;
+    int64_t endNs;
+};
+
+// Timestamp query profiler with one query slot per frame in flight. A slot's results are read
+// when the slot is next begun, so readback never waits on the GPU
+class GpuProfiler
+{
+  public:
+    // calibratedTimestamps is whether VK_EXT_calibrated_timestamps was enabled on device
+    void create(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice,
+                uint32_t queueFamily, uint32_t frameCount, bool calibratedTimestamps);
+    void destroy();
+
+    // The previous submission using frameIndex must have completed
+    void beginFrame(VkCommandBuffer cmd, uint32_t frameIndex, uint64_t frameNumber);
+
+    uint32_t beginScope(VkCommandBuffer cmd, const char* name,
+                        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT);
+    void endScope(VkCommandBuffer cmd, uint32_t scope,
+                  VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+    bool isEnabled() const { return m_QueryPool != VK_NULL_HANDLE; }
+    bool isCalibrated() const { return m_Calibrated; }
+
+    // Rolling statistics over the last m_HistorySize resolved frames, in scope creation order
+    const std::vector<GpuScopeStats>& getStats() const { return m_Stats; }
+    const GpuScopeStats* findStats(const std::string& name) const;
+
+    const std::vector<GpuScopeEvent>& getLastFrameEvents() const { return m_LastFrameEvents; }
+    uint64_t getLastResolvedFrame() const { return m_LastResolvedFrame; }
+
+    void exportJson(std::ostream& out) const;
+
+  private:
+    struct RecordedScope {
+        uint32_t scope;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct FrameSlot {
+        uint64_t frameNumber;
+        bool pending;
+        uint32_t queryCount;
+        uint32_t openScopes; // Each still needs its end query
+        std::vector<RecordedScope> scopes;
+    };
+
+    // Whether the device can calibrate its own clock against CLOCK_MONOTONIC
+    static bool supportsHostDomain(VkInstance instance, VkPhysicalDevice physicalDevice);
+
+    void resolve(uint32_t frameIndex);
+    void calibrate();
+
+    uint32_t findScope(const char* name);
+
+  private:
+    static constexpr uint32_t m_MaxQueriesPerFrame = 64;
+    static constexpr size_t m_HistorySize = 128;
+
+    VkDevice m_Device;
+    VkQueryPool m_QueryPool = VK_NULL_HANDLE;
+
+    double m_NsPerTick = 1.0;
+    uint64_t m_TimestampMask = UINT64_MAX;
+
+    bool m_Calibrated = false;
+    PFN_vkGetCalibratedTimestampsEXT m_GetCalibratedTimestamps = nullptr;
+    VkTimeDomainEXT m_HostDomain;
+    uint64_t m_CalibrationDevice = 0;
+    int64_t m_CalibrationHostNs = 0;
+
+    std::vector<FrameSlot> m_Slots;
+    uint32_t m_CurrentSlot = 0;
+
+    std::vector<GpuScopeStats> m_Stats;
+    std::vector<std::array<double, m_HistorySize>> m_History;
+    std::vector<size_t> m_HistoryCount;
+
+    std::vector<GpuScopeEvent> m_LastFrameEvents;
+    uint64_t m_LastResolvedFrame = 0;
+};
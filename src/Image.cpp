@@ -1,8 +1,8 @@
 #include "Image.hpp"
 
-#include "Buffer.hpp"
+#include "CpuProfiler.hpp"
 #include "ErrorCheck.hpp"
-#include "ImmediateSubmit.hpp"
+#include "UploadBatch.hpp"
 
 #include <stb_image.h>
 
@@ -34,8 +34,8 @@ void AllocatedImage::create(VkDevice device, VmaAllocator allocator, VkExtent3D
 
     VK_CHECK(vmaCreateImage(allocator, &imageCI, &allocateCI, &image, &allocation, nullptr));
 
-    VkImageAspectFlags aspectFlags =
-        (format == VK_FORMAT_D32_SFLOAT) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    bool depth = format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM;
+    VkImageAspectFlags aspectFlags = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
     VkImageViewCreateInfo imageViewCI{};
     imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     imageViewCI.pNext = nullptr;
@@ -51,9 +51,11 @@ void AllocatedImage::create(VkDevice device, VmaAllocator allocator, VkExtent3D
     VK_CHECK(vkCreateImageView(device, &imageViewCI, nullptr, &imageView));
 }
 
-void AllocatedImage::load(VkDevice device, VmaAllocator allocator, std::filesystem::path file,
-                          VkImageUsageFlags usage)
+void AllocatedImage::load(VkDevice device, VmaAllocator allocator, UploadBatch& batch,
+                          std::filesystem::path file, VkImageUsageFlags usage)
 {
+    PROFILE_FUNCTION();
+
     int width, height, channels;
     uint8_t* data = stbi_load(file.c_str(), &width, &height, &channels, 4);
 
@@ -63,37 +65,11 @@ void AllocatedImage::load(VkDevice device, VmaAllocator allocator, std::filesyst
 
         size_t size = imageExtent.width * imageExtent.height * imageExtent.depth * 4;
 
-        AllocatedBuffer uploadBuffer;
-        uploadBuffer.createBuffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                  VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-        memcpy(uploadBuffer.allocationInfo.pMappedData, data, size);
-
         create(device, allocator, imageExtent, VK_FORMAT_R8G8B8A8_UNORM,
                usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
-        ImmediateSubmit::submit([&](VkCommandBuffer cmd) {
-            AllocatedImage::transition(cmd, image, VK_IMAGE_LAYOUT_UNDEFINED,
-                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-            VkBufferImageCopy copyRegion{};
-            copyRegion.bufferOffset = 0;
-            copyRegion.bufferRowLength = 0;
-            copyRegion.bufferImageHeight = 0;
-            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            copyRegion.imageSubresource.mipLevel = 0;
-            copyRegion.imageSubresource.baseArrayLayer = 0;
-            copyRegion.imageSubresource.layerCount = 1;
-            copyRegion.imageExtent = imageExtent;
-
-            vkCmdCopyBufferToImage(cmd, uploadBuffer.buffer, image,
-                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-            AllocatedImage::transition(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-        });
-
-        uploadBuffer.destroyBuffer(allocator);
+        // Pixels are copied into the staging arena here, so they can be freed straight away
+        batch.copyToImage(image, data, size, imageExtent);
 
         stbi_image_free(data);
     }
@@ -103,7 +79,8 @@ void AllocatedImage::load(VkDevice device, VmaAllocator allocator, std::filesyst
     }
 }
 
-void AllocatedImage::createSampler(VkDevice device, VkFilter filter)
+void AllocatedImage::createSampler(VkDevice device, VkFilter filter,
+                                   std::optional<VkCompareOp> compareOp)
 {
     VkSamplerCreateInfo samplerCI{};
     samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -114,6 +91,8 @@ void AllocatedImage::createSampler(VkDevice device, VkFilter filter)
     samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
     samplerCI.maxLod = VK_LOD_CLAMP_NONE;
     samplerCI.minLod = 0;
+    samplerCI.compareEnable = compareOp.has_value() ? VK_TRUE : VK_FALSE;
+    samplerCI.compareOp = compareOp.value_or(VK_COMPARE_OP_NEVER);
 
     VkSampler sampler;
     VK_CHECK(vkCreateSampler(device, &samplerCI, nullptr, &sampler));
@@ -7,6 +7,8 @@
 #include <filesystem>
 #include <optional>
 
+class UploadBatch;
+
 class AllocatedImage
 {
   public:
@@ -22,10 +24,12 @@ class AllocatedImage
     void create(VkDevice device, VmaAllocator allocator, VkExtent3D extent, VkFormat format,
                 VkImageUsageFlags usage);
 
-    void load(VkDevice device, VmaAllocator allocator, std::filesystem::path file,
-              VkImageUsageFlags usage);
+    void load(VkDevice device, VmaAllocator allocator, UploadBatch& batch,
+              std::filesystem::path file, VkImageUsageFlags usage);
 
-    void createSampler(VkDevice device, VkFilter filter);
+    // A compareOp makes a depth comparison sampler, for sampler2DShadow lookups
+    void createSampler(VkDevice device, VkFilter filter,
+                       std::optional<VkCompareOp> compareOp = std::nullopt);
 
     void destroy(VkDevice device, VmaAllocator allocator);
 
@@ -0,0 +1,190 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+
+#include "CpuProfiler.hpp"
+
+static thread_local const JobSystem* t_JobSystem = nullptr;
+static thread_local size_t t_ThreadIndex = 0;
+
+void JobSystem::create(size_t workerCount)
+{
+    m_Stopping = false;
+
+    for (size_t i = 0; i < workerCount + 1; i++)
+        m_Queues.push_back(std::make_unique<WorkQueue>());
+
+    for (size_t i = 0; i < workerCount; i++)
+        m_Workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+}
+
+void JobSystem::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_Stopping = true;
+    }
+    m_WorkAvailable.notify_all();
+
+    for (std::thread& worker : m_Workers)
+        worker.join();
+
+    m_Workers.clear();
+    m_Queues.clear();
+}
+
+size_t JobSystem::getThreadIndex() const { return t_JobSystem == this ? t_ThreadIndex : 0; }
+
+JobHandle JobSystem::submit(std::function<void(size_t thread)>&& function,
+                            std::span<const JobHandle> dependencies)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->function = std::move(function);
+
+    for (const JobHandle& dependency : dependencies)
+    {
+        if (!dependency) continue;
+
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->finished) continue;
+
+        job->pendingDependencies++;
+        dependency->continuations.push_back(job);
+    }
+
+    // Drop the reference submit() held, scheduling the job if nothing else is outstanding
+    if (--job->pendingDependencies == 0) schedule(job);
+
+    return job;
+}
+
+JobHandle JobSystem::parallelFor(
+    size_t count, size_t grainSize,
+    const std::function<void(size_t begin, size_t end, size_t thread)>& function,
+    std::span<const JobHandle> dependencies)
+{
+    grainSize = std::max<size_t>(grainSize, 1);
+
+    std::vector<JobHandle> ranges;
+    for (size_t begin = 0; begin < count; begin += grainSize)
+    {
+        size_t end = std::min(begin + grainSize, count);
+        ranges.push_back(submit(
+            [function, begin, end](size_t thread) { function(begin, end, thread); }, dependencies));
+    }
+
+    // An empty job that finishes after every range, or straight away when there are none
+    std::span<const JobHandle> joinDependencies = ranges;
+    if (ranges.empty()) joinDependencies = dependencies;
+
+    return submit([](size_t) {}, joinDependencies);
+}
+
+void JobSystem::wait(const JobHandle& handle)
+{
+    PROFILE_FUNCTION();
+
+    size_t thread = getThreadIndex();
+    while (!isFinished(handle))
+    {
+        if (JobHandle job = findJob(thread))
+            execute(job, thread);
+        else
+            std::this_thread::yield();
+    }
+}
+
+bool JobSystem::isFinished(const JobHandle& handle)
+{
+    if (!handle) return true;
+
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    return handle->finished;
+}
+
+void JobSystem::schedule(JobHandle job)
+{
+    WorkQueue& queue = *m_Queues[getThreadIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    m_QueuedJobs++;
+
+    // Taking the lock orders this with a worker checking the count before it sleeps
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+    }
+    m_WorkAvailable.notify_one();
+}
+
+void JobSystem::execute(const JobHandle& job, size_t thread)
+{
+    job->function(thread);
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        continuations = std::move(job->continuations);
+    }
+
+    for (JobHandle& continuation : continuations)
+    {
+        if (--continuation->pendingDependencies == 0) schedule(std::move(continuation));
+    }
+}
+
+JobHandle JobSystem::findJob(size_t thread)
+{
+    // Newest local work first, it is the most likely to still be in cache
+    {
+        WorkQueue& queue = *m_Queues[thread];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            m_QueuedJobs--;
+            return job;
+        }
+    }
+
+    // Steal the oldest work from the other threads, which tends to be the largest
+    for (size_t i = 1; i < m_Queues.size(); i++)
+    {
+        WorkQueue& queue = *m_Queues[(thread + i) % m_Queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            m_QueuedJobs--;
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::workerLoop(size_t thread)
+{
+    t_JobSystem = this;
+    t_ThreadIndex = thread;
+
+    PROFILE_THREAD_NAME("worker");
+
+    while (true)
+    {
+        if (JobHandle job = findJob(thread))
+        {
+            execute(job, thread);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_SleepMutex);
+        m_WorkAvailable.wait(lock, [this]() { return m_Stopping || m_QueuedJobs > 0; });
+
+        if (m_Stopping) return;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+struct Job;
+
+// Completes once the job has run and, for parallelFor(), once every range has run
+using JobHandle = std::shared_ptr<Job>;
+
+struct Job {
+    std::function<void(size_t thread)> function;
+
+    // Unfinished dependencies, plus one held by submit() while they are registered
+    std::atomic<uint32_t> pendingDependencies = 1;
+
+    std::mutex mutex;
+    bool finished = false;
+    std::vector<JobHandle> continuations;
+};
+
+// Work-stealing scheduler. Every thread owns a deque: it pushes and pops its own work at the back
+// while idle threads steal from the front of the others. Thread index 0 belongs to whichever
+// non-worker thread submits and waits (the main thread), workers are 1 to getThreadCount() - 1
+class JobSystem
+{
+  public:
+    void create(size_t workerCount);
+    void destroy();
+
+    size_t getThreadCount() const { return m_Workers.size() + 1; }
+
+    // Index of the calling thread, stable for the lifetime of the job system
+    size_t getThreadIndex() const;
+
+    // Runs once every dependency has finished
+    JobHandle submit(std::function<void(size_t thread)>&& function,
+                     std::span<const JobHandle> dependencies = {});
+
+    // Splits [0, count) into ranges of at most grainSize items, one job each
+    JobHandle
+    parallelFor(size_t count, size_t grainSize,
+                const std::function<void(size_t begin, size_t end, size_t thread)>& function,
+                std::span<const JobHandle> dependencies = {});
+
+    // Runs queued jobs on the calling thread until handle has finished
+    void wait(const JobHandle& handle);
+
+    static bool isFinished(const JobHandle& handle);
+
+  private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    void schedule(JobHandle job);
+    void execute(const JobHandle& job, size_t thread);
+
+    JobHandle findJob(size_t thread);
+
+    void workerLoop(size_t thread);
+
+  private:
+    std::vector<std::thread> m_Workers;
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+
+    std::atomic<size_t> m_QueuedJobs = 0;
+
+    std::mutex m_SleepMutex;
+    std::condition_variable m_WorkAvailable;
+    bool m_Stopping = false;
+};
@@ -1,19 +1,40 @@
-#define VMA_IMPLEMENTATION
-
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
 #include "Engine.hpp"
 
+#include <cstring>
 #include <iostream>
+#include <string>
 
-int main()
+int main(int argc, char** argv)
 {
-    std::unique_ptr<Engine> engine = std::make_unique<Engine>();
+    EngineConfig config{};
+    size_t headlessFrames = 100;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+            config.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--headless") == 0)
+            config.headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            headlessFrames = std::stoull(argv[++i]);
+    }
+
+    std::unique_ptr<Engine> engine = std::make_unique<Engine>(config);
+
+    if (config.headless)
+    {
+        for (size_t i = 0; i < headlessFrames; i++)
+            engine->step(1000.0 / 60.0);
+
+        engine->waitIdle();
+    }
+    else
+    {
+        engine->run();
+    }
 
     return 0;
 }
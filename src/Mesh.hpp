@@ -1,12 +1,12 @@
 #pragma once
 
-#include <cstring>
 #include <span>
 
 #include <vk_mem_alloc.h>
 
 #include "Buffer.hpp"
-#include "ImmediateSubmit.hpp"
+#include "CpuProfiler.hpp"
+#include "UploadBatch.hpp"
 
 struct VmaAllocation_T;
 
@@ -16,14 +16,17 @@ class Mesh
     AllocatedBuffer indexBuffer;
     AllocatedBuffer vertexBuffer;
     VkDeviceAddress vertexBufferAddress;
+    VkDeviceAddress indexBufferAddress;
 
     uint32_t indexCount;
 
   public:
     template<typename T>
-    void createMesh(VkDevice device, VmaAllocator allocator, std::span<uint32_t> indices,
-                    std::span<T> vertices)
+    void createMesh(VkDevice device, VmaAllocator allocator, UploadBatch& batch,
+                    std::span<uint32_t> indices, std::span<T> vertices)
     {
+        PROFILE_FUNCTION();
+
         const size_t vertexBufferSize = vertices.size() * sizeof(T);
         const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
 
@@ -36,7 +39,9 @@ class Mesh
                                   VMA_MEMORY_USAGE_GPU_ONLY);
         indexBuffer.createBuffer(allocator, indexBufferSize,
                                  VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
                                  VMA_MEMORY_USAGE_GPU_ONLY);
 
         VkBufferDeviceAddressInfo deviceAI{};
@@ -46,33 +51,15 @@ class Mesh
 
         vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAI);
 
-        AllocatedBuffer staging;
-        staging.createBuffer(allocator, vertexBufferSize + indexBufferSize,
-                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_COPY);
-
-        void* data;
-        vmaMapMemory(allocator, staging.allocation, &data);
-        memcpy(data, vertices.data(), vertexBufferSize);
-        memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
-        vmaUnmapMemory(allocator, staging.allocation);
-
-        ImmediateSubmit::submit([&](VkCommandBuffer cmd) {
-            VkBufferCopy vertexCopy{};
-            vertexCopy.srcOffset = 0;
-            vertexCopy.dstOffset = 0;
-            vertexCopy.size = vertexBufferSize;
-
-            vkCmdCopyBuffer(cmd, staging.buffer, vertexBuffer.buffer, 1, &vertexCopy);
-
-            VkBufferCopy indexCopy{};
-            indexCopy.srcOffset = vertexBufferSize;
-            indexCopy.dstOffset = 0;
-            indexCopy.size = indexBufferSize;
-
-            vkCmdCopyBuffer(cmd, staging.buffer, indexBuffer.buffer, 1, &indexCopy);
-        });
+        deviceAI.buffer = indexBuffer.buffer;
+        indexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAI);
 
-        staging.destroyBuffer(allocator);
+        batch.copyToBuffer(vertexBuffer.buffer, vertices.data(), vertexBufferSize, 0,
+                           VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                           VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+        batch.copyToBuffer(indexBuffer.buffer, indices.data(), indexBufferSize, 0,
+                           VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                           VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
     }
 
     void destroyMesh(VmaAllocator allocator)
@@ -80,5 +67,6 @@ class Mesh
         vertexBuffer.destroyBuffer(allocator);
         indexBuffer.destroyBuffer(allocator);
         vertexBufferAddress = 0;
+        indexBufferAddress = 0;
     }
 };
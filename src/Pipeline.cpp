@@ -2,6 +2,7 @@
 
 #include <vulkan/vk_enum_string_helper.h>
 
+#include "CpuProfiler.hpp"
 #include "ErrorCheck.hpp"
 
 #include <fstream>
@@ -13,6 +14,8 @@ PipelineLayoutBuilder::build(VkDevice device,
                              std::initializer_list<VkPushConstantRange> pushConstants,
                              std::initializer_list<VkDescriptorSetLayout> descriptorLayouts)
 {
+    PROFILE_FUNCTION();
+
     VkPipelineLayoutCreateInfo pipelineLayoutCI{};
     pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(descriptorLayouts.size());
@@ -30,6 +33,8 @@ VkPipelineLayout PipelineLayoutBuilder ::build(VkDevice device,
                                                std::span<VkPushConstantRange> pushConstants,
                                                std::span<VkDescriptorSetLayout> descriptorLayouts)
 {
+    PROFILE_FUNCTION();
+
     VkPipelineLayoutCreateInfo pipelineLayoutCI{};
     pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(descriptorLayouts.size());
@@ -129,6 +134,13 @@ PipelineBuilder& PipelineBuilder::setMultisampleNone()
     return *this;
 }
 
+PipelineBuilder& PipelineBuilder::setViewportCount(uint32_t count)
+{
+    m_ViewportCount = count;
+
+    return *this;
+}
+
 PipelineBuilder& PipelineBuilder::disableBlending()
 {
     m_ColourBlendAS.blendEnable = VK_FALSE;
@@ -205,6 +217,8 @@ PipelineBuilder& PipelineBuilder::enableDepthTest(bool depthWriteEnable, VkCompa
 
 VkPipeline PipelineBuilder::build()
 {
+    PROFILE_FUNCTION();
+
     m_RenderCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
     m_RenderCI.pNext = nullptr;
     m_RenderCI.colorAttachmentCount = static_cast<uint32_t>(m_ColourFormats.size());
@@ -214,9 +228,9 @@ VkPipeline PipelineBuilder::build()
     viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportStateCI.pNext = nullptr;
     viewportStateCI.flags = 0;
-    viewportStateCI.viewportCount = 1;
+    viewportStateCI.viewportCount = m_ViewportCount;
     viewportStateCI.pViewports = nullptr;
-    viewportStateCI.scissorCount = 1;
+    viewportStateCI.scissorCount = m_ViewportCount;
     viewportStateCI.pScissors = nullptr;
 
     const std::vector<VkPipelineColorBlendAttachmentState> blendStates(m_ColourFormats.size(),
@@ -282,6 +296,8 @@ std::optional<VkShaderModule> PipelineBuilder::createShaderModule(VkDevice devic
 
                                                                   std::filesystem::path filePath)
 {
+    PROFILE_FUNCTION();
+
     std::ifstream file(filePath, std::ios::ate | std::ios::binary);
 
     if (!file.is_open())
@@ -314,9 +330,53 @@ std::optional<VkShaderModule> PipelineBuilder::createShaderModule(VkDevice devic
 
 PipelineBuilder::PipelineBuilder(VkDevice device, VkPipelineLayout layout)
     : m_Device{ device }, m_PipelineLayout{ layout }, m_ShaderStages{}, m_ColourAttachmentFormat{},
-      m_InputAssemblyCI{}, m_RasterizerCI{}, m_ColourBlendAS{}, m_MultisampleCI{},
-      m_DepthStencilCI{}, m_RenderCI{}
+      m_ViewportCount{ 1 }, m_InputAssemblyCI{}, m_RasterizerCI{}, m_ColourBlendAS{},
+      m_MultisampleCI{}, m_DepthStencilCI{}, m_RenderCI{}
 {
     m_RenderCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
     m_RenderCI.pNext = nullptr;
 }
+
+ComputePipelineBuilder ComputePipelineBuilder::start(VkDevice device, VkPipelineLayout layout)
+{
+    ComputePipelineBuilder builder(device, layout);
+    return builder;
+}
+
+ComputePipelineBuilder& ComputePipelineBuilder::setShader(VkShaderModule compShaderModule)
+{
+    m_ShaderStage = { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                      .pNext = nullptr,
+                      .flags = 0,
+                      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                      .module = compShaderModule,
+                      .pName = "main" };
+
+    return *this;
+}
+
+VkPipeline ComputePipelineBuilder::build()
+{
+    PROFILE_FUNCTION();
+
+    VkComputePipelineCreateInfo computePipelineCI{};
+    computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineCI.pNext = nullptr;
+    computePipelineCI.stage = m_ShaderStage;
+    computePipelineCI.layout = m_PipelineLayout;
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr,
+                                 &pipeline) != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create compute pipeline\n";
+        pipeline = VK_NULL_HANDLE;
+    }
+
+    return pipeline;
+}
+
+ComputePipelineBuilder::ComputePipelineBuilder(VkDevice device, VkPipelineLayout layout)
+    : m_Device{ device }, m_PipelineLayout{ layout }, m_ShaderStage{}
+{
+}
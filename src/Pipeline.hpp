@@ -32,6 +32,9 @@ class PipelineBuilder
                                 VkFrontFace frontFace);
     PipelineBuilder& setMultisampleNone();
 
+    // Viewports and scissors are dynamic, this is only how many the pipeline uses
+    PipelineBuilder& setViewportCount(uint32_t count);
+
     PipelineBuilder& disableBlending();
 
     PipelineBuilder& addColourAttachmentFormat(VkFormat format);
@@ -59,6 +62,7 @@ class PipelineBuilder
     std::vector<VkFormat> m_ColourFormats;
 
     VkFormat m_ColourAttachmentFormat;
+    uint32_t m_ViewportCount;
     VkPipelineInputAssemblyStateCreateInfo m_InputAssemblyCI;
     VkPipelineRasterizationStateCreateInfo m_RasterizerCI;
     VkPipelineColorBlendAttachmentState m_ColourBlendAS;
@@ -66,3 +70,22 @@ class PipelineBuilder
     VkPipelineDepthStencilStateCreateInfo m_DepthStencilCI;
     VkPipelineRenderingCreateInfo m_RenderCI;
 };
+
+class ComputePipelineBuilder
+{
+  public:
+    static ComputePipelineBuilder start(VkDevice device, VkPipelineLayout layout);
+
+    ComputePipelineBuilder& setShader(VkShaderModule compShaderModule);
+
+    VkPipeline build();
+
+  private:
+    ComputePipelineBuilder(VkDevice device, VkPipelineLayout layout);
+
+  private:
+    VkDevice m_Device;
+    VkPipelineLayout m_PipelineLayout;
+
+    VkPipelineShaderStageCreateInfo m_ShaderStage;
+};
@@ -0,0 +1,51 @@
+#include "RingBuffer.hpp"
+
+#include <format>
+#include <stdexcept>
+
+void RingBuffer::create(VmaAllocator allocator, size_t frameSize, size_t frameCount,
+                        size_t alignment, VkBufferUsageFlags usage)
+{
+    m_Alignment = alignment > 0 ? alignment : 1;
+    m_FrameSize = align(frameSize);
+    m_FrameCount = frameCount;
+
+    buffer.createBuffer(allocator, m_FrameSize * m_FrameCount, usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    beginFrame(0);
+}
+
+void RingBuffer::destroy(VmaAllocator allocator) { buffer.destroyBuffer(allocator); }
+
+void RingBuffer::beginFrame(size_t frameIndex)
+{
+    m_FrameStart = (frameIndex % m_FrameCount) * m_FrameSize;
+    m_Head = m_FrameStart;
+}
+
+void RingBuffer::flush(VmaAllocator allocator)
+{
+    // No-op on HOST_COHERENT memory, required otherwise
+    vmaFlushAllocation(allocator, buffer.allocation, m_FrameStart, m_Head - m_FrameStart);
+}
+
+RingAllocation RingBuffer::allocate(size_t size)
+{
+    size_t alignedSize = align(size);
+
+    if (m_Head + alignedSize > m_FrameStart + m_FrameSize)
+    {
+        throw std::runtime_error(
+            std::format("RingBuffer frame segment exhausted: {} + {} > {} bytes",
+                        m_Head - m_FrameStart, alignedSize, m_FrameSize));
+    }
+
+    RingAllocation allocation{};
+    allocation.data = (char*)buffer.allocationInfo.pMappedData + m_Head;
+    allocation.offset = static_cast<uint32_t>(m_Head);
+    allocation.size = size;
+
+    m_Head += alignedSize;
+
+    return allocation;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vk_mem_alloc.h>
+
+#include <cstring>
+#include <format>
+#include <span>
+#include <stdexcept>
+
+#include "Buffer.hpp"
+
+struct RingAllocation {
+    void* data;
+    uint32_t offset;
+    size_t size;
+};
+
+// Persistently mapped buffer split into one segment per frame in flight. Each frame linearly
+// allocates from its own segment, which is only rewritten once that frame's fence has been waited
+// on, so data can be written in place and bound with dynamic offsets.
+class RingBuffer
+{
+  public:
+    AllocatedBuffer buffer;
+
+  public:
+    void create(VmaAllocator allocator, size_t frameSize, size_t frameCount, size_t alignment,
+                VkBufferUsageFlags usage);
+
+    void destroy(VmaAllocator allocator);
+
+    void beginFrame(size_t frameIndex);
+    void flush(VmaAllocator allocator);
+
+    RingAllocation allocate(size_t size);
+
+    // Copies data into a fresh allocation of reserveSize bytes, which data must fit in
+    template<typename T>
+    RingAllocation push(const std::span<T>& data, size_t reserveSize)
+    {
+        if (data.size_bytes() > reserveSize)
+        {
+            throw std::runtime_error(
+                std::format("RingBuffer push of {} bytes exceeds the {} reserved for it",
+                            data.size_bytes(), reserveSize));
+        }
+
+        RingAllocation allocation = allocate(reserveSize);
+        memcpy(allocation.data, data.data(), data.size() * sizeof(T));
+        return allocation;
+    }
+
+    size_t getFrameSize() const { return m_FrameSize; }
+
+  private:
+    size_t align(size_t size) const { return (size + m_Alignment - 1) & ~(m_Alignment - 1); }
+
+  private:
+    size_t m_FrameSize = 0;
+    size_t m_FrameCount = 0;
+    size_t m_Alignment = 1;
+
+    size_t m_FrameStart = 0;
+    size_t m_Head = 0;
+};
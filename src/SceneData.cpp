@@ -0,0 +1,187 @@
+#include "SceneData.hpp"
+
+#include <utility>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+static constexpr float SHADOW_NEAR = 0.1f;
+
+// Direction and up vector of each cube face, in layer order
+static const std::pair<glm::vec3, glm::vec3> FACE_DIRECTIONS[6] = {
+    {{ 1.0f, 0.0f, 0.0f },   { 0.0f, -1.0f, 0.0f }},
+    { { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }},
+    { { 0.0f, 1.0f, 0.0f },  { 0.0f, 0.0f, -1.0f }},
+    { { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+    { { 0.0f, 0.0f, 1.0f },  { 0.0f, -1.0f, 0.0f }},
+    { { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }},
+};
+
+void updateObjectMatrices(ObjectData& object, const ObjectTransform& transform)
+{
+    glm::mat4 rotation =
+        glm::rotate(glm::mat4(1.0f), glm::radians(transform.angle), transform.rotationAxis);
+
+    glm::mat4 model{ 1.0f };
+    model = glm::translate(model, transform.position);
+    model = model * rotation;
+    model = glm::scale(model, transform.scale);
+
+    object.model = model;
+    object.rotation = rotation;
+}
+
+// Any up vector that is not parallel to direction
+static glm::vec3 getUpVector(const glm::vec3& direction)
+{
+    if (glm::abs(direction.y) > 0.99f) return glm::vec3(0.0f, 0.0f, 1.0f);
+    return glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+uint32_t getShadowFaceCount(const LightData& light)
+{
+    if (light.shadowIndex == NO_SHADOW) return 0;
+    return light.type == LightType::Point ? 6 : 1;
+}
+
+void updateShadowFaceMatrices(const LightData& light, std::span<ShadowFaceData> faces)
+{
+    glm::vec3 direction = glm::normalize(light.direction);
+    glm::vec3 up = getUpVector(direction);
+
+    // Reverse-Z like the point light faces, near and far are swapped
+    if (light.type == LightType::Directional)
+    {
+        glm::vec3 eye = light.position - direction * light.radius;
+        glm::mat4 view = glm::lookAt(eye, light.position, up);
+
+        float size = light.radius;
+        glm::mat4 proj = glm::ortho(-size, size, -size, size, 2.0f * size, SHADOW_NEAR);
+        proj[1][1] *= -1;
+
+        faces[0].viewProj = proj * view;
+        return;
+    }
+
+    // Atlas tiles are square, a spot face is the square around its outer cone
+    float fov = light.type == LightType::Spot
+                    ? 2.0f * glm::acos(glm::clamp(light.spotOuterCos, 0.0f, 1.0f))
+                    : glm::radians(90.0f);
+
+    glm::mat4 proj{ 1.0f };
+    proj = glm::perspective(glm::clamp(fov, glm::radians(1.0f), glm::radians(179.0f)), 1.0f,
+                            light.radius, SHADOW_NEAR);
+    proj[1][1] *= -1;
+
+    if (light.type == LightType::Spot)
+    {
+        faces[0].viewProj = proj * glm::lookAt(light.position, light.position + direction, up);
+        return;
+    }
+
+    for (int j = 0; j < 6; j++)
+    {
+        glm::mat4 view = glm::lookAt(light.position, light.position + FACE_DIRECTIONS[j].first,
+                                     FACE_DIRECTIONS[j].second);
+        faces[j].viewProj = proj * view;
+    }
+}
+
+float getLightRadius(const LightData& light, float cutoff, float maxRadius)
+{
+    // Solves max(colour) / (constant + linear * d + quadratic * d^2) = cutoff for d
+    glm::vec3 colour = glm::max(light.diffuse, light.specular);
+    float brightest = glm::max(colour.r, glm::max(colour.g, colour.b));
+    float constant = light.attenuation.x - brightest / cutoff;
+    float linear = light.attenuation.y;
+    float quadratic = light.attenuation.z;
+
+    float radius = maxRadius;
+    if (constant >= 0.0f)
+        radius = 0.0f;
+    else if (quadratic > 0.0f)
+        radius = (-linear + glm::sqrt(linear * linear - 4.0f * quadratic * constant)) /
+                 (2.0f * quadratic);
+    else if (linear > 0.0f)
+        radius = -constant / linear;
+
+    return glm::min(radius, maxRadius);
+}
+
+Frustum getFrustum(const glm::mat4& viewProj)
+{
+    // Rows of the matrix, glm stores columns
+    glm::mat4 rows = glm::transpose(viewProj);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+
+    for (glm::vec4& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere)
+{
+    for (const glm::vec4& plane : frustum.planes)
+    {
+        if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w) return false;
+    }
+    return true;
+}
+
+glm::vec4 getObjectBounds(const ObjectTransform& transform)
+{
+    glm::vec3 scale = glm::abs(transform.scale);
+    float radius = 0.5f * glm::sqrt(3.0f) * glm::max(scale.x, glm::max(scale.y, scale.z));
+    return glm::vec4(transform.position, radius);
+}
+
+bool sphereInShadowFace(const LightData& light, int face, const glm::vec4& sphere)
+{
+    glm::vec3 offset = glm::vec3(sphere) - light.position;
+    float radius = sphere.w;
+
+    if (light.type == LightType::Directional)
+    {
+        // The orthographic box, radius on each side of position along all three axes
+        glm::vec3 direction = glm::normalize(light.direction);
+        glm::vec3 up = getUpVector(direction);
+        glm::vec3 side = glm::normalize(glm::cross(direction, up));
+        up = glm::cross(side, direction);
+
+        float extent = light.radius + radius;
+        return glm::abs(glm::dot(offset, direction)) <= extent &&
+               glm::abs(glm::dot(offset, side)) <= extent &&
+               glm::abs(glm::dot(offset, up)) <= extent;
+    }
+
+    if (glm::length(offset) - radius > light.radius) return false;
+
+    if (light.type == LightType::Spot)
+    {
+        // Distance from the sphere's centre to the cone's surface, negative inside it
+        glm::vec3 direction = glm::normalize(light.direction);
+        float cosine = glm::clamp(light.spotOuterCos, 0.0f, 1.0f);
+        float sine = glm::sqrt(1.0f - cosine * cosine);
+
+        float along = glm::dot(offset, direction);
+        float across = glm::sqrt(glm::max(glm::dot(offset, offset) - along * along, 0.0f));
+        return along >= -radius && cosine * across - along * sine <= radius;
+    }
+
+    // The face is the 90 degree pyramid around its axis. Each side plane has the normal
+    // (axis - side) / sqrt(2), so the sphere is outside once it is over radius behind any of them
+    glm::vec3 axis = FACE_DIRECTIONS[face].first;
+    glm::vec3 up = FACE_DIRECTIONS[face].second;
+    glm::vec3 side = glm::cross(axis, up);
+
+    float along = glm::dot(offset, axis);
+    float limit = -radius * glm::sqrt(2.0f);
+
+    return along - glm::abs(glm::dot(offset, up)) >= limit &&
+           along - glm::abs(glm::dot(offset, side)) >= limit;
+}
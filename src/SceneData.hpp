@@ -0,0 +1,120 @@
+#pragma once
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+
+struct ObjectData {
+    alignas(16) int materialIndex;
+    alignas(16) glm::vec4 colour;
+    alignas(16) glm::mat4 model;
+    alignas(16) glm::mat4 rotation;
+};
+
+// Matches the GBUFFER_ constants in gbuffer.glsl
+enum class GBufferLayout : int32_t {
+    Full = 0,       // Position, normal and texture coordinates with the material index, 20 bytes
+    Compact = 1,    // Position from depth, octahedral normal and pre-sampled albedo, 8 bytes
+    Visibility = 2, // Object and triangle index only, everything else is fetched again, 4 bytes
+};
+
+struct LightGeneralData {
+    alignas(16) int lightCount;
+    int shadowMaskLights; // Leading lights whose shadows come from the half resolution mask
+    GBufferLayout gBufferLayout;
+    int lightTilesPerRow; // Engine::getLightTileCount().width
+    alignas(16) glm::vec4 ambient;
+};
+
+// Matches the LIGHT_ constants in light.glsl
+enum class LightType : uint32_t {
+    Point = 0,       // Six perspective shadow faces, one per cube face
+    Spot = 1,        // One perspective shadow face covering the cone
+    Directional = 2, // One orthographic shadow face, attenuation is ignored
+};
+
+// LightData::shadowIndex of a light that casts no shadows and owns no shadow faces
+constexpr uint32_t NO_SHADOW = UINT32_MAX;
+
+// What the lighting loop reads per light, the shadow projections live in ShadowFaceData
+struct LightData {
+    // Directional lights centre their shadow volume here
+    alignas(16) glm::vec3 position;
+
+    // Reach of the light, also the far plane of its shadow faces. Point and spot lights get theirs
+    // from getLightRadius, directional lights cover a box of this half size around position
+    float radius = 40.0f;
+
+    alignas(16) glm::vec3 diffuse;
+    uint32_t shadowIndex = 0; // First of the light's ShadowFaceData entries, or NO_SHADOW
+    alignas(16) glm::vec3 specular;
+    LightType type = LightType::Point;
+    alignas(16) glm::vec3 attenuation;
+    float spotInnerCos = 1.0f; // Full intensity inside this cone
+    alignas(16) glm::vec3 direction{ 0.0f, 1.0f, 0.0f }; // Spot and directional lights only
+    float spotOuterCos = 0.0f; // No light outside this cone
+};
+
+// One face of a light's shadow map, indexed by LightData::shadowIndex + face
+struct ShadowFaceData {
+    alignas(16) glm::mat4 viewProj;
+
+    // Atlas UV offset in xy and scale in zw
+    alignas(16) glm::vec4 rect;
+};
+
+// An object drawn into one shadow face, indexed by gl_InstanceIndex in the shadow pass
+struct ShadowCaster {
+    uint32_t object;
+    uint32_t face; // Index into the shadow face table
+};
+
+struct MaterialData {
+    alignas(16) glm::vec3 ambient;
+    alignas(16) glm::vec3 diffuse;
+    alignas(16) glm::vec4 specular;
+};
+
+// CPU side placement of an object, turned into ObjectData matrices every update
+struct ObjectTransform {
+    glm::vec3 position{ 0.0f };
+    glm::vec3 rotationAxis{ 0.0f, 1.0f, 0.0f };
+    float angle = 0.0f; // Degrees
+    glm::vec3 scale{ 1.0f };
+
+    bool operator==(const ObjectTransform&) const = default;
+};
+
+// Writes model and rotation. Touches nothing but object, so objects can be updated in parallel
+void updateObjectMatrices(ObjectData& object, const ObjectTransform& transform);
+
+// Shadow faces the light needs, 6 for a point light, 0 without shadows and 1 otherwise
+uint32_t getShadowFaceCount(const LightData& light);
+
+// Writes the view-projection of each of the light's faces, leaving the atlas rects alone. faces
+// holds getShadowFaceCount(light) entries
+void updateShadowFaceMatrices(const LightData& light, std::span<ShadowFaceData> faces);
+
+// Distance at which the light's attenuated colour falls to cutoff, clamped to maxRadius. Lights
+// with constant attenuation never fall off and get maxRadius
+float getLightRadius(const LightData& light, float cutoff, float maxRadius);
+
+// Side planes of a camera frustum, inward facing with the distance in w. There is no far plane,
+// everything past it is far enough to leave a light's contribution unnoticed anyway
+struct Frustum {
+    glm::vec4 planes[4];
+};
+
+Frustum getFrustum(const glm::mat4& viewProj);
+
+// Whether a sphere, centre in xyz and radius in w, touches the frustum. Conservative near corners
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere);
+
+// Sphere around the unit cube mesh placed by transform, centre in xyz and radius in w
+glm::vec4 getObjectBounds(const ObjectTransform& transform);
+
+// Whether a sphere can cast into one face of a light's shadow map. Conservative, a true result may
+// still leave the face untouched
+bool sphereInShadowFace(const LightData& light, int face, const glm::vec4& sphere);
@@ -0,0 +1,89 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+// Every other bit of a Z-order index, giving one coordinate of the cell it names
+static uint32_t compactBits(uint64_t index)
+{
+    uint32_t value = 0;
+    for (uint32_t bit = 0; bit < 32; bit++)
+        value |= static_cast<uint32_t>((index >> (2 * bit)) & 1) << bit;
+    return value;
+}
+
+void ShadowAtlas::create(VkFormat format, VkFilter filter, uint32_t minTileSize,
+                         uint32_t maxTileSize)
+{
+    m_Format = format;
+    m_Filter = filter;
+    m_MinTileSize = std::bit_ceil(minTileSize);
+    m_MaxTileSize = std::bit_ceil(std::max(maxTileSize, m_MinTileSize));
+    m_Extent = { 0, 0 };
+}
+
+void ShadowAtlas::destroy(VkDevice device, VmaAllocator allocator)
+{
+    if (m_Extent.width != 0) image.destroy(device, allocator);
+    m_Extent = { 0, 0 };
+}
+
+VkExtent2D ShadowAtlas::pack(std::span<const uint32_t> sizes, std::vector<ShadowTile>& tiles) const
+{
+    tiles.resize(sizes.size());
+
+    std::vector<size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    // Counted in cells of m_MinTileSize. Going from largest to smallest keeps every tile aligned to
+    // its own size on the curve, so each one is a square block of cells
+    uint64_t cell = 0;
+    VkExtent2D extent = { 0, 0 };
+    for (size_t index : order)
+    {
+        uint32_t size = std::clamp(std::bit_ceil(sizes[index]), m_MinTileSize, m_MaxTileSize);
+        uint64_t cellsPerSide = size / m_MinTileSize;
+
+        ShadowTile& tile = tiles[index];
+        tile.x = compactBits(cell) * m_MinTileSize;
+        tile.y = compactBits(cell >> 1) * m_MinTileSize;
+        tile.size = size;
+
+        extent.width = std::max(extent.width, tile.x + size);
+        extent.height = std::max(extent.height, tile.y + size);
+
+        cell += cellsPerSide * cellsPerSide;
+    }
+
+    return extent;
+}
+
+bool ShadowAtlas::fits(VkExtent2D extent) const
+{
+    return extent.width <= m_Extent.width && extent.height <= m_Extent.height;
+}
+
+void ShadowAtlas::grow(VkDevice device, VmaAllocator allocator, VkExtent2D extent)
+{
+    extent.width = std::max(extent.width, m_Extent.width);
+    extent.height = std::max(extent.height, m_Extent.height);
+
+    destroy(device, allocator);
+
+    image.create(device, allocator, { extent.width, extent.height, 1 }, m_Format,
+                 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    // Reverse-Z, a fragment is lit when its depth is at least the stored occluder depth
+    image.createSampler(device, m_Filter, VK_COMPARE_OP_GREATER_OR_EQUAL);
+
+    m_Extent = extent;
+}
+
+size_t ShadowAtlas::getMemoryUsage() const
+{
+    size_t texelSize = m_Format == VK_FORMAT_D16_UNORM ? 2 : 4;
+    return static_cast<size_t>(m_Extent.width) * m_Extent.height * texelSize;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vk_mem_alloc.h>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Image.hpp"
+
+struct ShadowTile {
+    uint32_t x;
+    uint32_t y;
+    uint32_t size;
+
+    bool operator==(const ShadowTile&) const = default;
+};
+
+// Packs square, power-of-two shadow map tiles into a single depth image. Tiles are placed largest
+// first along a Z-order curve, which leaves no gaps between them, so any packing fits an image
+// sized for a packing of at least as many tiles of at least the same sizes
+class ShadowAtlas
+{
+  public:
+    AllocatedImage image;
+
+  public:
+    // A linear filter turns each comparison lookup into a 2x2 percentage closer filter
+    void create(VkFormat format, VkFilter filter, uint32_t minTileSize, uint32_t maxTileSize);
+    void destroy(VkDevice device, VmaAllocator allocator);
+
+    // Places one tile per entry in sizes, each rounded to a power of two within the tile limits.
+    // Returns the extent covering every tile, which is all the shadow pass needs to clear
+    VkExtent2D pack(std::span<const uint32_t> sizes, std::vector<ShadowTile>& tiles) const;
+
+    // Whether extent fits in the current image
+    bool fits(VkExtent2D extent) const;
+
+    // Recreates the image large enough for extent. The GPU must be done with the old image
+    void grow(VkDevice device, VmaAllocator allocator, VkExtent2D extent);
+
+    VkExtent2D getExtent() const { return m_Extent; }
+    VkFormat getFormat() const { return m_Format; }
+    size_t getMemoryUsage() const;
+
+  private:
+    VkFormat m_Format;
+    VkFilter m_Filter;
+    uint32_t m_MinTileSize;
+    uint32_t m_MaxTileSize;
+
+    VkExtent2D m_Extent = { 0, 0 };
+};
@@ -0,0 +1,91 @@
+#include "ShadowScheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void ShadowScheduler::create(uint32_t faceBudget, double budgetMs)
+{
+    m_FaceBudget = faceBudget;
+    m_BudgetMs = budgetMs;
+
+    m_Waiting.clear();
+    m_History.clear();
+    m_Report = {};
+}
+
+const ShadowUpdateReport& ShadowScheduler::schedule(uint64_t frame,
+                                                    std::span<const ShadowFaceRequest> requests)
+{
+    uint32_t budget = m_FaceBudget != 0 ? m_FaceBudget : UINT32_MAX;
+    if (m_BudgetMs > 0.0 && m_Report.msPerFace > 0.0)
+    {
+        double affordable = std::floor(m_BudgetMs / m_Report.msPerFace);
+        budget = std::min(budget, static_cast<uint32_t>(std::clamp(affordable, 1.0, 1e9)));
+    }
+
+    m_Report.frame = frame;
+    m_Report.faceBudget = budget;
+    m_Report.refreshedFaces.clear();
+
+    std::vector<std::pair<float, uint32_t>>& stale = m_Stale;
+    std::vector<uint32_t>& waiting = m_NextWaiting;
+    stale.clear();
+    waiting.assign(m_Waiting.size(), 0);
+    for (const ShadowFaceRequest& request : requests)
+    {
+        if (request.face >= waiting.size())
+        {
+            waiting.resize(request.face + 1, 0);
+            m_Waiting.resize(request.face + 1, 0);
+        }
+
+        if (request.required)
+        {
+            m_Report.refreshedFaces.push_back(request.face);
+            continue;
+        }
+
+        // Age grows the priority linearly, so a face is picked eventually whatever its importance
+        float priority = request.importance * static_cast<float>(m_Waiting[request.face] + 1);
+        stale.push_back({ priority, request.face });
+        waiting[request.face] = m_Waiting[request.face] + 1;
+    }
+
+    size_t remaining = budget > m_Report.refreshedFaces.size()
+                           ? budget - m_Report.refreshedFaces.size()
+                           : 0;
+    size_t picked = std::min(remaining, stale.size());
+    std::partial_sort(stale.begin(), stale.begin() + picked, stale.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    for (size_t i = 0; i < picked; i++)
+    {
+        m_Report.refreshedFaces.push_back(stale[i].second);
+        waiting[stale[i].second] = 0;
+    }
+
+    // Faces that were not requested this frame are up to date and stop ageing
+    m_Waiting.swap(waiting);
+
+    std::sort(m_Report.refreshedFaces.begin(), m_Report.refreshedFaces.end());
+    m_Report.deferredFaces = static_cast<uint32_t>(stale.size() - picked);
+
+    m_History.push_back({ frame, static_cast<uint32_t>(m_Report.refreshedFaces.size()) });
+    if (m_History.size() > m_MaxHistory) m_History.pop_front();
+
+    return m_Report;
+}
+
+void ShadowScheduler::reportGpuTime(uint64_t frame, double ms)
+{
+    auto entry = std::find_if(m_History.begin(), m_History.end(),
+                              [frame](const auto& entry) { return entry.first == frame; });
+    if (entry == m_History.end() || entry->second == 0) return;
+
+    // Smoothed, one slow frame should not starve the next few
+    double msPerFace = ms / entry->second;
+    m_Report.msPerFace =
+        m_Report.msPerFace == 0.0 ? msPerFace : 0.9 * m_Report.msPerFace + 0.1 * msPerFace;
+
+    m_History.erase(entry);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <utility>
+#include <vector>
+
+struct ShadowFaceRequest {
+    uint32_t face;
+
+    // The face holds nothing usable, e.g. its tile just moved, so it cannot be put off
+    bool required;
+
+    // Relative worth of refreshing the face this frame
+    float importance;
+};
+
+struct ShadowUpdateReport {
+    uint64_t frame = 0;
+
+    // Faces redrawn this frame, ascending
+    std::vector<uint32_t> refreshedFaces;
+
+    // Stale faces left for a later frame
+    uint32_t deferredFaces = 0;
+
+    // Faces the budget allowed this frame, UINT32_MAX when unlimited
+    uint32_t faceBudget = UINT32_MAX;
+
+    // Running estimate of GPU time per face, 0 until the first measurement arrives
+    double msPerFace = 0.0;
+};
+
+// Spreads shadow face refreshes over frames. Required faces always go, the remaining budget goes to
+// stale faces by importance multiplied by how many frames they have already waited, so nothing
+// starves however low its importance
+class ShadowScheduler
+{
+  public:
+    // Either budget may be 0 to leave it unlimited
+    void create(uint32_t faceBudget, double budgetMs);
+
+    const ShadowUpdateReport& schedule(uint64_t frame, std::span<const ShadowFaceRequest> requests);
+
+    // Measured GPU time of an earlier frame's shadow pass, used for the millisecond budget
+    void reportGpuTime(uint64_t frame, double ms);
+
+    const ShadowUpdateReport& getReport() const { return m_Report; }
+
+  private:
+    uint32_t m_FaceBudget = 0;
+    double m_BudgetMs = 0.0;
+
+    // Frames each face has been waiting, indexed by face
+    std::vector<uint32_t> m_Waiting;
+
+    // Scratch for schedule, kept between calls so it stops allocating once the face count settles
+    std::vector<std::pair<float, uint32_t>> m_Stale;
+    std::vector<uint32_t> m_NextWaiting;
+
+    // Faces refreshed by recent frames, matched against late GPU timings
+    std::deque<std::pair<uint64_t, uint32_t>> m_History;
+    static constexpr size_t m_MaxHistory = 16;
+
+    ShadowUpdateReport m_Report;
+};
@@ -0,0 +1,102 @@
+#include "StagingArena.hpp"
+
+#include <algorithm>
+
+void StagingArena::create(VmaAllocator allocator, size_t chunkSize)
+{
+    m_Allocator = allocator;
+    m_ChunkSize = chunkSize;
+}
+
+void StagingArena::destroy()
+{
+    for (Chunk& chunk : m_Chunks)
+    {
+        chunk.buffer.destroyBuffer(m_Allocator);
+    }
+
+    m_Chunks.clear();
+    m_CurrentChunk = SIZE_MAX;
+}
+
+StagingAllocation StagingArena::allocate(size_t size, size_t alignment)
+{
+    auto aligned = [alignment](size_t offset) {
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+
+    if (m_CurrentChunk != SIZE_MAX)
+    {
+        Chunk& current = m_Chunks[m_CurrentChunk];
+        if (aligned(current.head) + size > current.size) m_CurrentChunk = SIZE_MAX;
+    }
+
+    if (m_CurrentChunk == SIZE_MAX)
+    {
+        Chunk* chunk = findChunk(size);
+        chunk->head = 0;
+        chunk->open = true;
+        m_CurrentChunk = chunk - m_Chunks.data();
+    }
+
+    Chunk& chunk = m_Chunks[m_CurrentChunk];
+    size_t offset = aligned(chunk.head);
+    chunk.head = offset + size;
+
+    return StagingAllocation{ .buffer = chunk.buffer.buffer,
+                              .offset = offset,
+                              .data = (char*)chunk.buffer.allocationInfo.pMappedData + offset };
+}
+
+void StagingArena::flush()
+{
+    for (Chunk& chunk : m_Chunks)
+    {
+        if (chunk.open) vmaFlushAllocation(m_Allocator, chunk.buffer.allocation, 0, chunk.head);
+    }
+}
+
+void StagingArena::retire(UploadTicket ticket)
+{
+    for (Chunk& chunk : m_Chunks)
+    {
+        if (!chunk.open) continue;
+
+        chunk.ticket = ticket;
+        chunk.open = false;
+    }
+
+    m_CurrentChunk = SIZE_MAX;
+}
+
+size_t StagingArena::getCapacity() const
+{
+    size_t capacity = 0;
+    for (const Chunk& chunk : m_Chunks)
+        capacity += chunk.size;
+
+    return capacity;
+}
+
+StagingArena::Chunk* StagingArena::findChunk(size_t size)
+{
+    for (Chunk& chunk : m_Chunks)
+    {
+        if (chunk.open || chunk.size < size) continue;
+
+        if (UploadManager::isComplete(chunk.ticket)) return &chunk;
+    }
+
+    // Oversized uploads get a chunk of their own rather than failing
+    Chunk chunk{};
+    chunk.size = std::max(size, m_ChunkSize);
+    chunk.head = 0;
+    chunk.ticket = 0;
+    chunk.open = false;
+    chunk.buffer.createBuffer(m_Allocator, chunk.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    m_Chunks.push_back(chunk);
+
+    return &m_Chunks.back();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vk_mem_alloc.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "UploadManager.hpp"
+
+struct StagingAllocation {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* data;
+};
+
+// Linear allocator over a set of persistently mapped staging chunks. Chunks written since the last
+// retire() are tied to that upload's ticket and are reused once the ticket has completed
+class StagingArena
+{
+  public:
+    void create(VmaAllocator allocator, size_t chunkSize);
+    void destroy();
+
+    StagingAllocation allocate(size_t size, size_t alignment = 16);
+
+    void flush();
+    void retire(UploadTicket ticket);
+
+    size_t getCapacity() const;
+
+  private:
+    struct Chunk {
+        AllocatedBuffer buffer;
+        size_t size;
+        size_t head;
+        UploadTicket ticket;
+        bool open;
+    };
+
+    Chunk* findChunk(size_t size);
+
+  private:
+    VmaAllocator m_Allocator;
+    size_t m_ChunkSize;
+
+    std::vector<Chunk> m_Chunks;
+    size_t m_CurrentChunk = SIZE_MAX;
+};
@@ -0,0 +1,168 @@
+#include "UploadBatch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include "CpuProfiler.hpp"
+
+UploadBatch UploadBatch::start(StagingArena& arena)
+{
+    UploadBatch batch{ arena };
+    return batch;
+}
+
+UploadBatch& UploadBatch::copyToBuffer(VkBuffer dst, const void* data, size_t size,
+                                       size_t dstOffset, VkPipelineStageFlags2 dstStage,
+                                       VkAccessFlags2 dstAccess)
+{
+    StagingAllocation staging = m_Arena->allocate(size);
+    memcpy(staging.data, data, size);
+    m_StagedBytes += size;
+
+    m_BufferCopies.push_back(BufferCopy{
+        .src = staging.buffer,
+        .dst = dst,
+        .region = VkBufferCopy{ .srcOffset = staging.offset, .dstOffset = dstOffset, .size = size },
+    });
+
+    addBufferOwnership({ .buffer = dst, .dstStage = dstStage, .dstAccess = dstAccess });
+
+    return *this;
+}
+
+UploadBatch& UploadBatch::copyToImage(VkImage dst, const void* data, size_t size, VkExtent3D extent,
+                                      VkImageAspectFlags aspect, VkImageLayout finalLayout)
+{
+    StagingAllocation staging = m_Arena->allocate(size);
+    memcpy(staging.data, data, size);
+    m_StagedBytes += size;
+
+    transition(dst, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, aspect);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = staging.offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = aspect;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = extent;
+
+    m_ImageCopies.push_back(ImageCopy{ .src = staging.buffer, .dst = dst, .region = region });
+
+    m_Ownership.images.push_back({ .image = dst,
+                                   .aspect = aspect,
+                                   .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   .newLayout = finalLayout });
+
+    return *this;
+}
+
+UploadBatch& UploadBatch::transition(VkImage image, VkImageLayout currentLayout,
+                                     VkImageLayout newLayout, VkImageAspectFlags aspect)
+{
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.pNext = nullptr;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = currentLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    m_Transitions.push_back(barrier);
+
+    return *this;
+}
+
+UploadTicket UploadBatch::flush()
+{
+    PROFILE_FUNCTION();
+
+    if (empty() && m_Transitions.empty()) return 0;
+
+    m_Arena->flush();
+
+    UploadTicket ticket =
+        UploadManager::submit([this](VkCommandBuffer cmd) { record(cmd); }, m_Ownership);
+
+    m_Arena->retire(ticket);
+
+    m_Transitions.clear();
+    m_BufferCopies.clear();
+    m_ImageCopies.clear();
+    m_Ownership = {};
+    m_StagedBytes = 0;
+
+    return ticket;
+}
+
+UploadBatch::UploadBatch(StagingArena& arena) : m_Arena{ &arena } {}
+
+void UploadBatch::addBufferOwnership(const BufferOwnership& ownership)
+{
+    for (BufferOwnership& existing : m_Ownership.buffers)
+    {
+        if (existing.buffer != ownership.buffer) continue;
+
+        existing.dstStage |= ownership.dstStage;
+        existing.dstAccess |= ownership.dstAccess;
+        return;
+    }
+
+    m_Ownership.buffers.push_back(ownership);
+}
+
+void UploadBatch::record(VkCommandBuffer cmd)
+{
+    if (!m_Transitions.empty())
+    {
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.pNext = nullptr;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(m_Transitions.size());
+        dependencyInfo.pImageMemoryBarriers = m_Transitions.data();
+
+        vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+    }
+
+    // Group copies sharing a source chunk and destination so each pair is one command
+    std::sort(m_BufferCopies.begin(), m_BufferCopies.end(),
+              [](const BufferCopy& a, const BufferCopy& b) {
+                  return std::tie(a.src, a.dst) < std::tie(b.src, b.dst);
+              });
+
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < m_BufferCopies.size();)
+    {
+        const BufferCopy& first = m_BufferCopies[i];
+
+        regions.clear();
+        for (; i < m_BufferCopies.size() && m_BufferCopies[i].src == first.src &&
+               m_BufferCopies[i].dst == first.dst;
+             i++)
+        {
+            regions.push_back(m_BufferCopies[i].region);
+        }
+
+        vkCmdCopyBuffer(cmd, first.src, first.dst, static_cast<uint32_t>(regions.size()),
+                        regions.data());
+    }
+
+    for (const ImageCopy& copy : m_ImageCopies)
+    {
+        vkCmdCopyBufferToImage(cmd, copy.src, copy.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                               &copy.region);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "StagingArena.hpp"
+#include "UploadManager.hpp"
+
+// Collects buffer copies, buffer-to-image copies and layout transitions, staging their data in a
+// StagingArena as they are added, then submits all of them as a single upload on flush()
+class UploadBatch
+{
+  public:
+    static UploadBatch start(StagingArena& arena);
+
+    UploadBatch& copyToBuffer(VkBuffer dst, const void* data, size_t size, size_t dstOffset = 0,
+                              VkPipelineStageFlags2 dstStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                              VkAccessFlags2 dstAccess = VK_ACCESS_2_MEMORY_READ_BIT);
+
+    // The image is moved to TRANSFER_DST before the copy and to finalLayout afterwards
+    UploadBatch& copyToImage(VkImage dst, const void* data, size_t size, VkExtent3D extent,
+                             VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+                             VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // Recorded in one barrier ahead of all copies
+    UploadBatch& transition(VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout,
+                            VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+
+    UploadTicket flush();
+
+    bool empty() const { return m_BufferCopies.empty() && m_ImageCopies.empty(); }
+    size_t getStagedBytes() const { return m_StagedBytes; }
+
+  private:
+    UploadBatch(StagingArena& arena);
+
+    void addBufferOwnership(const BufferOwnership& ownership);
+
+    void record(VkCommandBuffer cmd);
+
+  private:
+    struct BufferCopy {
+        VkBuffer src;
+        VkBuffer dst;
+        VkBufferCopy region;
+    };
+
+    struct ImageCopy {
+        VkBuffer src;
+        VkImage dst;
+        VkBufferImageCopy region;
+    };
+
+    StagingArena* m_Arena;
+
+    std::vector<VkImageMemoryBarrier2> m_Transitions;
+    std::vector<BufferCopy> m_BufferCopies;
+    std::vector<ImageCopy> m_ImageCopies;
+
+    UploadOwnership m_Ownership;
+
+    size_t m_StagedBytes = 0;
+};
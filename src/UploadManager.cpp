@@ -0,0 +1,325 @@
+#include "UploadManager.hpp"
+
+#include "CpuProfiler.hpp"
+#include "ErrorCheck.hpp"
+
+VkDevice UploadManager::m_Device;
+
+VkQueue UploadManager::m_GraphicsQueue;
+uint32_t UploadManager::m_GraphicsQueueFamily;
+VkQueue UploadManager::m_TransferQueue;
+uint32_t UploadManager::m_TransferQueueFamily;
+
+VkCommandPool UploadManager::m_TransferCommandPool;
+VkCommandPool UploadManager::m_GraphicsCommandPool;
+std::vector<VkCommandBuffer> UploadManager::m_FreeTransferCommandBuffers;
+std::vector<VkCommandBuffer> UploadManager::m_FreeGraphicsCommandBuffers;
+
+VkSemaphore UploadManager::m_TransferSemaphore;
+VkSemaphore UploadManager::m_ReadySemaphore;
+UploadTicket UploadManager::m_LastTicket = 0;
+
+std::deque<UploadManager::PendingUpload> UploadManager::m_Pending;
+
+void UploadManager::init(VkDevice device, VkQueue graphicsQueue, uint32_t graphicsQueueFamily,
+                         VkQueue transferQueue, uint32_t transferQueueFamily)
+{
+    m_Device = device;
+    m_GraphicsQueue = graphicsQueue;
+    m_GraphicsQueueFamily = graphicsQueueFamily;
+    m_TransferQueue = transferQueue;
+    m_TransferQueueFamily = transferQueueFamily;
+
+    VkCommandPoolCreateInfo commandPoolCI{};
+    commandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCI.pNext = nullptr;
+    commandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    commandPoolCI.queueFamilyIndex = m_TransferQueueFamily;
+    VK_CHECK(vkCreateCommandPool(m_Device, &commandPoolCI, nullptr, &m_TransferCommandPool));
+
+    commandPoolCI.queueFamilyIndex = m_GraphicsQueueFamily;
+    VK_CHECK(vkCreateCommandPool(m_Device, &commandPoolCI, nullptr, &m_GraphicsCommandPool));
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeCI{};
+    semaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeCI.pNext = nullptr;
+    semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeCI.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCI{};
+    semaphoreCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCI.pNext = &semaphoreTypeCI;
+
+    VK_CHECK(vkCreateSemaphore(m_Device, &semaphoreCI, nullptr, &m_TransferSemaphore));
+    VK_CHECK(vkCreateSemaphore(m_Device, &semaphoreCI, nullptr, &m_ReadySemaphore));
+
+    m_LastTicket = 0;
+}
+
+UploadTicket UploadManager::submit(std::function<void(VkCommandBuffer cmd)>&& function,
+                                   const UploadOwnership& ownership,
+                                   std::function<void()>&& onComplete)
+{
+    PROFILE_FUNCTION();
+
+    UploadTicket ticket = ++m_LastTicket;
+
+    VkCommandBufferBeginInfo commandBufferBI{};
+    commandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBI.pNext = nullptr;
+    commandBufferBI.pInheritanceInfo = nullptr;
+    commandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkCommandBuffer transferCmd =
+        getCommandBuffer(m_TransferCommandPool, m_FreeTransferCommandBuffers);
+
+    VK_CHECK(vkBeginCommandBuffer(transferCmd, &commandBufferBI));
+    function(transferCmd);
+    recordOwnership(transferCmd, ownership, true);
+    VK_CHECK(vkEndCommandBuffer(transferCmd));
+
+    VkCommandBufferSubmitInfo transferCommandSI{};
+    transferCommandSI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    transferCommandSI.pNext = nullptr;
+    transferCommandSI.commandBuffer = transferCmd;
+    transferCommandSI.deviceMask = 0;
+
+    VkSemaphoreSubmitInfo readySI{};
+    readySI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    readySI.pNext = nullptr;
+    readySI.semaphore = m_ReadySemaphore;
+    readySI.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    readySI.deviceIndex = 0;
+    readySI.value = ticket;
+
+    VkCommandBuffer acquireCmd = VK_NULL_HANDLE;
+
+    if (!usesTransferQueue())
+    {
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.pNext = nullptr;
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &transferCommandSI;
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &readySI;
+
+        VK_CHECK(vkQueueSubmit2(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+    }
+    else
+    {
+        VkSemaphoreSubmitInfo transferSI{};
+        transferSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        transferSI.pNext = nullptr;
+        transferSI.semaphore = m_TransferSemaphore;
+        transferSI.stageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+        transferSI.deviceIndex = 0;
+        transferSI.value = ticket;
+
+        VkSubmitInfo2 transferSubmitInfo{};
+        transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        transferSubmitInfo.pNext = nullptr;
+        transferSubmitInfo.commandBufferInfoCount = 1;
+        transferSubmitInfo.pCommandBufferInfos = &transferCommandSI;
+        transferSubmitInfo.signalSemaphoreInfoCount = 1;
+        transferSubmitInfo.pSignalSemaphoreInfos = &transferSI;
+
+        VK_CHECK(vkQueueSubmit2(m_TransferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE));
+
+        // The acquire half of each ownership transfer has to execute on the graphics queue
+        VkCommandBufferSubmitInfo acquireCommandSI{};
+        acquireCommandSI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        acquireCommandSI.pNext = nullptr;
+        acquireCommandSI.deviceMask = 0;
+
+        if (!ownership.buffers.empty() || !ownership.images.empty())
+        {
+            acquireCmd = getCommandBuffer(m_GraphicsCommandPool, m_FreeGraphicsCommandBuffers);
+
+            VK_CHECK(vkBeginCommandBuffer(acquireCmd, &commandBufferBI));
+            recordOwnership(acquireCmd, ownership, false);
+            VK_CHECK(vkEndCommandBuffer(acquireCmd));
+
+            acquireCommandSI.commandBuffer = acquireCmd;
+        }
+
+        transferSI.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo2 acquireSubmitInfo{};
+        acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        acquireSubmitInfo.pNext = nullptr;
+        acquireSubmitInfo.waitSemaphoreInfoCount = 1;
+        acquireSubmitInfo.pWaitSemaphoreInfos = &transferSI;
+        acquireSubmitInfo.commandBufferInfoCount = acquireCmd != VK_NULL_HANDLE ? 1 : 0;
+        acquireSubmitInfo.pCommandBufferInfos = &acquireCommandSI;
+        acquireSubmitInfo.signalSemaphoreInfoCount = 1;
+        acquireSubmitInfo.pSignalSemaphoreInfos = &readySI;
+
+        VK_CHECK(vkQueueSubmit2(m_GraphicsQueue, 1, &acquireSubmitInfo, VK_NULL_HANDLE));
+    }
+
+    m_Pending.push_back(PendingUpload{ .ticket = ticket,
+                                       .transferCommandBuffer = transferCmd,
+                                       .acquireCommandBuffer = acquireCmd,
+                                       .onComplete = std::move(onComplete) });
+
+    return ticket;
+}
+
+bool UploadManager::isComplete(UploadTicket ticket)
+{
+    uint64_t value;
+    VK_CHECK(vkGetSemaphoreCounterValue(m_Device, m_ReadySemaphore, &value));
+
+    return value >= ticket;
+}
+
+void UploadManager::wait(UploadTicket ticket)
+{
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.pNext = nullptr;
+    waitInfo.flags = 0;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_ReadySemaphore;
+    waitInfo.pValues = &ticket;
+
+    VK_CHECK(vkWaitSemaphores(m_Device, &waitInfo, UINT64_MAX));
+}
+
+void UploadManager::collect()
+{
+    uint64_t value;
+    VK_CHECK(vkGetSemaphoreCounterValue(m_Device, m_ReadySemaphore, &value));
+
+    while (!m_Pending.empty() && m_Pending.front().ticket <= value)
+    {
+        PendingUpload& upload = m_Pending.front();
+
+        if (upload.onComplete) upload.onComplete();
+
+        VK_CHECK(vkResetCommandBuffer(upload.transferCommandBuffer, 0));
+        m_FreeTransferCommandBuffers.push_back(upload.transferCommandBuffer);
+
+        if (upload.acquireCommandBuffer != VK_NULL_HANDLE)
+        {
+            VK_CHECK(vkResetCommandBuffer(upload.acquireCommandBuffer, 0));
+            m_FreeGraphicsCommandBuffers.push_back(upload.acquireCommandBuffer);
+        }
+
+        m_Pending.pop_front();
+    }
+}
+
+void UploadManager::free()
+{
+    wait(m_LastTicket);
+    collect();
+
+    vkDestroyCommandPool(m_Device, m_TransferCommandPool, nullptr);
+    vkDestroyCommandPool(m_Device, m_GraphicsCommandPool, nullptr);
+
+    m_FreeTransferCommandBuffers.clear();
+    m_FreeGraphicsCommandBuffers.clear();
+
+    vkDestroySemaphore(m_Device, m_TransferSemaphore, nullptr);
+    vkDestroySemaphore(m_Device, m_ReadySemaphore, nullptr);
+}
+
+VkCommandBuffer UploadManager::getCommandBuffer(VkCommandPool pool,
+                                                std::vector<VkCommandBuffer>& freeList)
+{
+    if (!freeList.empty())
+    {
+        VkCommandBuffer cmd = freeList.back();
+        freeList.pop_back();
+        return cmd;
+    }
+
+    VkCommandBufferAllocateInfo commandBufferAI{};
+    commandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAI.pNext = nullptr;
+    commandBufferAI.commandPool = pool;
+    commandBufferAI.commandBufferCount = 1;
+    commandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    VkCommandBuffer cmd;
+    VK_CHECK(vkAllocateCommandBuffers(m_Device, &commandBufferAI, &cmd));
+
+    return cmd;
+}
+
+void UploadManager::recordOwnership(VkCommandBuffer cmd, const UploadOwnership& ownership,
+                                    bool release)
+{
+    if (ownership.buffers.empty() && ownership.images.empty()) return;
+
+    // With a single queue family this is one ordinary barrier; otherwise the release half only
+    // carries the source scope and the acquire half only the destination scope
+    const bool transfer = usesTransferQueue();
+    const bool sourceHalf = !transfer || release;
+    const bool destinationHalf = !transfer || !release;
+
+    const uint32_t srcQueueFamily = transfer ? m_TransferQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+    const uint32_t dstQueueFamily = transfer ? m_GraphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+
+    std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+    bufferBarriers.reserve(ownership.buffers.size());
+
+    for (const BufferOwnership& buffer : ownership.buffers)
+    {
+        VkBufferMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.pNext = nullptr;
+        barrier.srcStageMask =
+            sourceHalf ? VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = sourceHalf ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_NONE;
+        barrier.dstStageMask = destinationHalf ? buffer.dstStage : VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = destinationHalf ? buffer.dstAccess : VK_ACCESS_2_NONE;
+        barrier.srcQueueFamilyIndex = srcQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.buffer = buffer.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        bufferBarriers.push_back(barrier);
+    }
+
+    std::vector<VkImageMemoryBarrier2> imageBarriers;
+    imageBarriers.reserve(ownership.images.size());
+
+    for (const ImageOwnership& image : ownership.images)
+    {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.pNext = nullptr;
+        barrier.srcStageMask =
+            sourceHalf ? VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = sourceHalf ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_NONE;
+        barrier.dstStageMask = destinationHalf ? image.dstStage : VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = destinationHalf ? image.dstAccess : VK_ACCESS_2_NONE;
+        barrier.oldLayout = image.oldLayout;
+        barrier.newLayout = image.newLayout;
+        barrier.srcQueueFamilyIndex = srcQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.image = image.image;
+        barrier.subresourceRange.aspectMask = image.aspect;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+        imageBarriers.push_back(barrier);
+    }
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.pNext = nullptr;
+    dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+    dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+    dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+}
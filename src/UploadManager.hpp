@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Value on UploadManager's timeline semaphore; the upload is visible to the graphics queue once
+// the semaphore reaches it
+using UploadTicket = uint64_t;
+
+struct BufferOwnership {
+    VkBuffer buffer;
+    VkPipelineStageFlags2 dstStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    VkAccessFlags2 dstAccess = VK_ACCESS_2_MEMORY_READ_BIT;
+};
+
+struct ImageOwnership {
+    VkImage image;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkImageLayout oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    VkImageLayout newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkPipelineStageFlags2 dstStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    VkAccessFlags2 dstAccess = VK_ACCESS_2_SHADER_READ_BIT;
+};
+
+// Resources written by an upload that the graphics queue will read. When the transfer queue is a
+// different family these are released on the transfer queue and acquired on the graphics queue,
+// otherwise a single barrier (including any layout change) is recorded after the copies
+struct UploadOwnership {
+    std::vector<BufferOwnership> buffers;
+    std::vector<ImageOwnership> images;
+};
+
+class UploadManager
+{
+  public:
+    static void init(VkDevice device, VkQueue graphicsQueue, uint32_t graphicsQueueFamily,
+                     VkQueue transferQueue, uint32_t transferQueueFamily);
+
+    // Records and submits without waiting. onComplete runs from collect() once the GPU is done,
+    // which is where staging memory should be released
+    static UploadTicket submit(std::function<void(VkCommandBuffer cmd)>&& function,
+                               const UploadOwnership& ownership,
+                               std::function<void()>&& onComplete = {});
+
+    static bool isComplete(UploadTicket ticket);
+    static void wait(UploadTicket ticket);
+
+    static void collect();
+
+    // Frames wait on this before reading anything that was uploaded
+    static VkSemaphore getSemaphore() { return m_ReadySemaphore; }
+    static UploadTicket getLastTicket() { return m_LastTicket; }
+
+    static bool usesTransferQueue() { return m_TransferQueueFamily != m_GraphicsQueueFamily; }
+
+    static void free();
+
+  private:
+    struct PendingUpload {
+        UploadTicket ticket;
+        VkCommandBuffer transferCommandBuffer;
+        VkCommandBuffer acquireCommandBuffer;
+        std::function<void()> onComplete;
+    };
+
+    static VkCommandBuffer getCommandBuffer(VkCommandPool pool,
+                                            std::vector<VkCommandBuffer>& freeList);
+
+    static void recordOwnership(VkCommandBuffer cmd, const UploadOwnership& ownership,
+                                bool release);
+
+  private:
+    static VkDevice m_Device;
+
+    static VkQueue m_GraphicsQueue;
+    static uint32_t m_GraphicsQueueFamily;
+    static VkQueue m_TransferQueue;
+    static uint32_t m_TransferQueueFamily;
+
+    static VkCommandPool m_TransferCommandPool;
+    static VkCommandPool m_GraphicsCommandPool;
+    static std::vector<VkCommandBuffer> m_FreeTransferCommandBuffers;
+    static std::vector<VkCommandBuffer> m_FreeGraphicsCommandBuffers;
+
+    static VkSemaphore m_TransferSemaphore;
+    static VkSemaphore m_ReadySemaphore;
+    static UploadTicket m_LastTicket;
+
+    static std::deque<PendingUpload> m_Pending;
+};
@@ -0,0 +1,6 @@
+// Single-header libraries are implemented here so every executable linking the engine gets them
+#define VMA_IMPLEMENTATION
+#include <vk_mem_alloc.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>